@@ -6,7 +6,9 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <stdexcept>
 #include "bst.h"
+#include "thread_pool.h"
 
 struct KeyError
 {
@@ -15,27 +17,27 @@ struct KeyError
 /**
  * A special kind of node for an AVL tree, which adds the balance as a data member, plus
  * other additional helper functions. You do NOT need to implement any functionality or
- * add additional data members or helper functions.
+ * add additional data members or helper functions. Threaded nodes also keep in-order
+ * neighbour links (see NodeThreads in bst.h).
  */
-template <typename Key, typename Value>
-class AVLNode : public Node<Key, Value>
+template <typename Key, typename Value, bool Threaded = false>
+class AVLNode : public Node<Key, Value, AVLNode<Key, Value, Threaded>, Threaded>
 {
 public:
-    // Constructor/destructor.
-    AVLNode(const Key &key, const Value &value, AVLNode<Key, Value> *parent);
-    virtual ~AVLNode();
+    // Constructor.
+    AVLNode(const Key &key, const Value &value, AVLNode<Key, Value, Threaded> *parent);
+    template <typename KeyArgs, typename ValueArgs>
+    AVLNode(AVLNode<Key, Value, Threaded> *parent, std::piecewise_construct_t, KeyArgs keyArgs, ValueArgs valueArgs);
 
     // Getter/setter for the node's height.
     int8_t getBalance() const;
     void setBalance(int8_t balance);
     void updateBalance(int8_t diff);
+    void setChildHeights(int leftHeight, int rightHeight);
 
-    // Getters for parent, left, and right. These need to be redefined since they
-    // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
-    // for more information.
-    virtual AVLNode<Key, Value> *getParent() const override;
-    virtual AVLNode<Key, Value> *getLeft() const override;
-    virtual AVLNode<Key, Value> *getRight() const override;
+    // Getters for parent, left, and right are inherited from Node and already
+    // return pointers to AVLNodes - not plain Nodes - since AVLNode passes itself
+    // as Node's Derived parameter. See the Node class in bst.h for more information.
 
 protected:
     int8_t balance_; // effectively a signed char
@@ -51,24 +53,26 @@ protected:
  * An explicit constructor to initialize the elements by calling the base class constructor and setting
  * the color to red since every new node will be red when it is first inserted.
  */
-template <class Key, class Value>
-AVLNode<Key, Value>::AVLNode(const Key &key, const Value &value, AVLNode<Key, Value> *parent) : Node<Key, Value>(key, value, parent), balance_(0)
+template <class Key, class Value, bool Threaded>
+AVLNode<Key, Value, Threaded>::AVLNode(const Key &key, const Value &value, AVLNode<Key, Value, Threaded> *parent) : Node<Key, Value, AVLNode<Key, Value, Threaded>, Threaded>(key, value, parent), balance_(0)
 {
 }
 
 /**
- * A destructor which does nothing.
+ * An in-place constructor, see the matching Node constructor.
  */
-template <class Key, class Value>
-AVLNode<Key, Value>::~AVLNode()
+template <class Key, class Value, bool Threaded>
+template <typename KeyArgs, typename ValueArgs>
+AVLNode<Key, Value, Threaded>::AVLNode(AVLNode<Key, Value, Threaded> *parent, std::piecewise_construct_t pc, KeyArgs keyArgs, ValueArgs valueArgs)
+    : Node<Key, Value, AVLNode<Key, Value, Threaded>, Threaded>(parent, pc, std::move(keyArgs), std::move(valueArgs)), balance_(0)
 {
 }
 
 /**
  * A getter for the balance of a AVLNode.
  */
-template <class Key, class Value>
-int8_t AVLNode<Key, Value>::getBalance() const
+template <class Key, class Value, bool Threaded>
+int8_t AVLNode<Key, Value, Threaded>::getBalance() const
 {
     return balance_;
 }
@@ -76,8 +80,8 @@ int8_t AVLNode<Key, Value>::getBalance() const
 /**
  * A setter for the balance of a AVLNode.
  */
-template <class Key, class Value>
-void AVLNode<Key, Value>::setBalance(int8_t balance)
+template <class Key, class Value, bool Threaded>
+void AVLNode<Key, Value, Threaded>::setBalance(int8_t balance)
 {
     balance_ = balance;
 }
@@ -85,300 +89,786 @@ void AVLNode<Key, Value>::setBalance(int8_t balance)
 /**
  * Adds diff to the balance of a AVLNode.
  */
-template <class Key, class Value>
-void AVLNode<Key, Value>::updateBalance(int8_t diff)
+template <class Key, class Value, bool Threaded>
+void AVLNode<Key, Value, Threaded>::updateBalance(int8_t diff)
 {
     balance_ += diff;
 }
 
 /**
- * An overridden function for getting the parent since a static_cast is necessary to make sure
- * that our node is a AVLNode.
+ * Sets the balance from the heights of a freshly built node's subtrees.
  */
-template <class Key, class Value>
-AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
+template <class Key, class Value, bool Threaded>
+void AVLNode<Key, Value, Threaded>::setChildHeights(int leftHeight, int rightHeight)
 {
-    return static_cast<AVLNode<Key, Value> *>(this->parent_);
+    balance_ = static_cast<int8_t>(rightHeight - leftHeight);
 }
 
+/*
+  -----------------------------------------------
+  End implementations for the AVLNode class.
+  -----------------------------------------------
+*/
+
 /**
- * Overridden for the same reasons as above.
+ * Updates in O(1) the balance factors of the two nodes a right rotation
+ * moves: n, the subtree's old root, and c, its left child lifted above it.
+ * Only these two change subtrees, so their new balances follow from the
+ * old ones. Shared by AVLTree and the standalone AVL trees, which store
+ * balances in their own node types.
  */
-template <class Key, class Value>
-AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
+inline void rightRotationBalances(int &nb, int &cb)
 {
-    return static_cast<AVLNode<Key, Value> *>(this->left_);
+    nb = nb + 1 - std::min(cb, 0);
+    cb = cb + 1 + std::max(nb, 0);
 }
 
 /**
- * Overridden for the same reasons as above.
+ * The mirror image of rightRotationBalances, with c n's right child
  */
-template <class Key, class Value>
-AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
+inline void leftRotationBalances(int &nb, int &cb)
 {
-    return static_cast<AVLNode<Key, Value> *>(this->right_);
+    nb = nb - 1 - std::max(cb, 0);
+    cb = cb - 1 + std::min(nb, 0);
 }
 
-/*
-  -----------------------------------------------
-  End implementations for the AVLNode class.
-  -----------------------------------------------
-*/
-
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+/**
+ * A templated self-balancing AVL tree. NodeT is AVLNode<Key, Value> or, for
+ * O(1) iterator steps, the threaded AVLNode<Key, Value, true>. Alloc hands out
+ * NodeT storage; pass NodePool<NodeT> to carve nodes out of contiguous blocks.
+ *
+ * Every node keeps its balance factor, height(right) - height(left), which is
+ * maintained incrementally: inserts retrace only while subtree heights grow,
+ * removes only while they shrink, and rotations fix the balances of the two
+ * nodes they move in O(1).
+ *
+ * join and split cut and splice whole trees in O(log n), and the set
+ * operations are built on them as parallel divide-and-conquer algorithms.
+ * These move nodes from one tree to another, so they are only available
+ * with allocators that do not own their nodes' storage (i.e. not NodePool).
+ */
+template <class Key, class Value, class Compare = std::less<Key>,
+          class NodeT = AVLNode<Key, Value>, class Alloc = HeapAllocator<NodeT> >
+class AVLTree : public BinarySearchTree<Key, Value, Compare, NodeT, Alloc>
 {
 public:
-    virtual void insert(const std::pair<const Key, Value> &new_item);
-    virtual void remove(const Key &key); // TODO
+    using BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::BinarySearchTree;
+
+    virtual void remove(const Key &key);
+
+    // Whole-tree operations; each leaves the tree passed in empty
+    void join(AVLTree &greater);
+    void split(const Key &key, AVLTree &greater);
+    void set_union(AVLTree &other, ThreadPool &pool = ThreadPool::shared());
+    void set_intersection(AVLTree &other, ThreadPool &pool = ThreadPool::shared());
+    void set_difference(AVLTree &other, ThreadPool &pool = ThreadPool::shared());
+
 protected:
-    virtual void nodeSwap(AVLNode<Key, Value> *n1, AVLNode<Key, Value> *n2);
+    virtual void nodeSwap(NodeT *n1, NodeT *n2) override;
+    virtual void insertFix(NodeT *n) override;
 
     // Add helper functions here
-    AVLNode<Key, Value> *rightRotation(AVLNode<Key, Value> *n);
-    AVLNode<Key, Value> *leftRotation(AVLNode<Key, Value> *n);
-    int calculateBalance(AVLNode<Key, Value> *n);
-    int getHeight(AVLNode<Key, Value> *n);
-    void updateBalances(AVLNode<Key, Value> *n);
-    void rebalanceTree(AVLNode<Key, Value> *ancestor, AVLNode<Key, Value> *newNode, AVLNode<Key, Value> *root);
+    NodeT *rightRotation(NodeT *n);
+    NodeT *leftRotation(NodeT *n);
+    bool insertFix(NodeT *p, NodeT *n);
+    void removeFix(NodeT *p, int8_t diff);
+    void replaceChild(NodeT *p, NodeT *oldChild, NodeT *newChild);
+
+    // join/split and the set operations work on detached subtrees, whose
+    // roots have no parent, passed around together with their heights
+    static int subtreeHeight(NodeT *n);
+    static void detachChildren(NodeT *t, int ht, NodeT *&l, int &hl, NodeT *&r, int &hr);
+    NodeT *detachTree(int &h);
+    void attachTree(NodeT *t);
+    NodeT *joinNodes(NodeT *l, int hl, NodeT *k, NodeT *r, int hr, int &h);
+    NodeT *joinNodes(NodeT *l, int hl, NodeT *r, int hr, int &h);
+    NodeT *splitNodes(NodeT *t, int ht, const Key &key, NodeT *&l, int &hl, NodeT *&r, int &hr);
+    NodeT *splitLast(NodeT *t, int ht, NodeT *&last, int &h);
+    NodeT *unionNodes(NodeT *t1, int h1, NodeT *t2, int h2, int &h, ThreadPool &pool);
+    NodeT *intersectNodes(NodeT *t1, int h1, NodeT *t2, int h2, int &h, ThreadPool &pool);
+    NodeT *differenceNodes(NodeT *t1, int h1, NodeT *t2, int h2, int &h, ThreadPool &pool);
+    template <typename F, typename G>
+    static void forkJoin(ThreadPool &pool, std::size_t work, F &&f, G &&g);
 };
 
-// @summary Helper function to calculate the ancestor nodes of the tree
-template <class Key, class Value>
-void AVLTree<Key, Value>::updateBalances(AVLNode<Key, Value> *n)
+/*
+ * Every insert (insert, emplace, try_emplace, insert_or_assign) goes through
+ * BinarySearchTree::emplaceUnique, which links the new leaf n and then calls
+ * this to rebalance. Recall: If key is already in the tree, the value is
+ * overwritten (or left alone) without a new node, so there is nothing to fix.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::insertFix(NodeT *n)
+{
+    // @summary Rebalance: the new leaf grew its parent's subtree on one side
+    insertFix(n->getParent(), n);
+}
+
+/**
+ * Retraces from p, whose child n has just grown taller by one.
+ * Stops as soon as a subtree's height stops changing, which is either
+ * when a balance returns to 0 or after the single rebalancing rotation.
+ * Returns true if the whole tree (or detached subtree) grew taller.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+bool AVLTree<Key, Value, Compare, NodeT, Alloc>::insertFix(NodeT *p, NodeT *n)
+{
+    while (p != nullptr)
+    {
+        int8_t diff = (p->getLeft() == n) ? -1 : 1;
+        p->updateBalance(diff);
+
+        // @condition Balanced again, so p's height did not change
+        if (p->getBalance() == 0)
+            return false;
+
+        // @condition p grew by one but is still balanced; keep retracing
+        if (p->getBalance() == diff)
+        {
+            n = p;
+            p = p->getParent();
+            continue;
+        }
+
+        // @summary p is off by two toward n: zig-zig needs one rotation, zig-zag two
+        int8_t nBalance = n->getBalance();
+        NodeT *top;
+        if (diff < 0)
+        {
+            if (nBalance > 0)
+                leftRotation(n);
+            top = rightRotation(p);
+        }
+        else
+        {
+            if (nBalance < 0)
+                rightRotation(n);
+            top = leftRotation(p);
+        }
+
+        // @condition Only a join can leave n balanced; then the rotated subtree is still one taller
+        if (nBalance != 0)
+            return false;
+        n = top;
+        p = top->getParent();
+    }
+    return true;
+}
+
+// @summary Point p (or the root, if p is NULL) at newChild instead of oldChild.
+// The root of a detached subtree is not root_, which is left alone.
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::replaceChild(NodeT *p, NodeT *oldChild, NodeT *newChild)
 {
-    int8_t lHeight = 0, rHeight = 0;
-    // std::cout << "UPDATING" << std::endl;
-    while (n != nullptr)
+    if (p == nullptr)
     {
-        if (n->getLeft() == nullptr)
-            lHeight = 0;
-        if (n->getLeft() != nullptr)
-            lHeight = n->getLeft()->getBalance();
-        if (n->getRight() == nullptr)
-            rHeight = 0;
-        if (n->getRight() != nullptr)
-            rHeight = n->getRight()->getBalance();
-        n->setBalance(std::max(lHeight, rHeight) + 1);
-        /*std::cout << std::max(lHeight, rHeight)+1 << std::endl;
-        std::cout << "L " << lHeight << std::endl;
-        std::cout << "R" << rHeight << std::endl;
-        std::cout << "----" << std::endl;*/
-        n = n->getParent();
+        if (this->root_ == oldChild)
+            this->root_ = newChild;
     }
+    else if (p->getLeft() == oldChild)
+        p->setLeft(newChild);
+    else
+        p->setRight(newChild);
+    if (newChild != nullptr)
+        newChild->setParent(p);
+}
+
+// @summary Helper function to rotate right
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::rightRotation(NodeT *n)
+{
+    NodeT *currLeft = n->getLeft();
+    NodeT *currLeft_RightChild = currLeft->getRight();
+
+    // @summary Move current node down, set left node equal to the right child of the child node (could be null)
+    replaceChild(n->getParent(), n, currLeft);
+    currLeft->setRight(n);
+    n->setParent(currLeft);
+    n->setLeft(currLeft_RightChild);
+    if (currLeft_RightChild != nullptr)
+        currLeft_RightChild->setParent(n);
+
+    // @summary currLeft now spans n's old subtree; n spans its new children
+    currLeft->setSubtreeSize(n->getSubtreeSize());
+    n->setSubtreeSize(1 + this->subtreeSize(n->getLeft()) + this->subtreeSize(n->getRight()));
+
+    // @summary Rebalance: only n and currLeft changed subtrees, so derive their balances in O(1)
+    int nb = n->getBalance(), lb = currLeft->getBalance();
+    rightRotationBalances(nb, lb);
+    n->setBalance(nb);
+    currLeft->setBalance(lb);
+
+    // Return new root
+    return currLeft;
+}
+
+// @summary Helper function to rotate left
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::leftRotation(NodeT *n)
+{
+    NodeT *currRight = n->getRight();
+    NodeT *currRight_LeftChild = currRight->getLeft();
+
+    // @summary Move current node down, set right node equal to the left child of the child node (could be null)
+    replaceChild(n->getParent(), n, currRight);
+    currRight->setLeft(n);
+    n->setParent(currRight);
+    n->setRight(currRight_LeftChild);
+    if (currRight_LeftChild != nullptr)
+        currRight_LeftChild->setParent(n);
+
+    // @summary currRight now spans n's old subtree; n spans its new children
+    currRight->setSubtreeSize(n->getSubtreeSize());
+    n->setSubtreeSize(1 + this->subtreeSize(n->getLeft()) + this->subtreeSize(n->getRight()));
+
+    // @summary Rebalance: only n and currRight changed subtrees, so derive their balances in O(1)
+    int nb = n->getBalance(), rb = currRight->getBalance();
+    leftRotationBalances(nb, rb);
+    n->setBalance(nb);
+    currRight->setBalance(rb);
+
+    // Return new root
+    return currRight;
 }
 
 /*
- * Recall: If key is already in the tree, you should
- * overwrite the current value with the updated value.
+ * Recall: The writeup specifies that if a node has 2 children you
+ * should swap with the predecessor and then remove.
  */
-template <class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::remove(const Key &key)
 {
-    // @summary Insert using BST insert method
-    // @condition Create new root node if it doesn't exist
-    if (this->root_ == nullptr)
-    {
-        this->root_ = new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
+    NodeT *n = this->internalFind(key);
+    if (n == nullptr)
         return;
+    this->unlinkThreads(n);
+
+    // @condition 2 child case: swap with predecessor, leaving n with at most 1 child
+    if (n->getLeft() != nullptr && n->getRight() != nullptr)
+    {
+        NodeT *pred = this->pred(n);
+        nodeSwap(n, pred);
     }
 
-    // @summary Search for appropiate key location
-    AVLNode<Key, Value> *p = nullptr;
-    AVLNode<Key, Value> *newNode = static_cast<AVLNode<Key, Value> *>(this->root_);
-    AVLNode<Key, Value> *ancestor = NULL;
-    AVLNode<Key, Value> *root = static_cast<AVLNode<Key, Value> *>(this->root_);
-    bool setLeftChild = false;
+    // @summary Splice n out, promoting its only child (if any)
+    NodeT *p = n->getParent();
+    NodeT *c = (n->getLeft() != nullptr) ? n->getLeft() : n->getRight();
+    int8_t diff = 0;
+    if (p != nullptr)
+        diff = (p->getLeft() == n) ? 1 : -1;
+    replaceChild(p, n, c);
+    this->destroyNode(n);
+    this->adjustSubtreeSizes(p, -1);
+
+    // @summary Rebalance: p's subtree lost one level on the side n was on
+    removeFix(p, diff);
+}
 
-    while (newNode != nullptr)
+/**
+ * Retraces from p, whose subtree on the side opposite diff has just become
+ * one level shorter. Stops as soon as a subtree's height stops changing.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::removeFix(NodeT *p, int8_t diff)
+{
+    while (p != nullptr)
     {
-        p = newNode; // will become the parent
+        // @summary Work out the next step before rotations move p
+        NodeT *g = p->getParent();
+        int8_t nextDiff = 0;
+        if (g != nullptr)
+            nextDiff = (g->getLeft() == p) ? 1 : -1;
+
+        p->updateBalance(diff);
 
-        // @condition If key is smaller, traverse left subtree
-        if (new_item.first < newNode->getKey())
+        // @condition p was balanced, so its height did not change
+        if (p->getBalance() == diff)
+            return;
+
+        // @condition p's taller side shrank; keep retracing
+        if (p->getBalance() == 0)
         {
-            newNode = newNode->getLeft();
-            setLeftChild = true;
+            p = g;
+            diff = nextDiff;
+            continue;
         }
-        else if (new_item.first > newNode->getKey())
-        {
 
-            newNode = newNode->getRight();
-            setLeftChild = false;
-
-        } // @condition If key is the same, update value
-        else if (new_item.first == newNode->getKey())
+        // @summary p is off by two toward its other child c; rotate c up
+        int8_t cBalance;
+        if (diff > 0)
         {
-            newNode->setValue(new_item.second);
-            ancestor = newNode;
-            return;
+            NodeT *c = p->getRight();
+            cBalance = c->getBalance();
+            if (cBalance < 0)
+                rightRotation(c);
+            leftRotation(p);
         }
+        else
+        {
+            NodeT *c = p->getLeft();
+            cBalance = c->getBalance();
+            if (cBalance > 0)
+                leftRotation(c);
+            rightRotation(p);
+        }
+
+        // @condition A single rotation about a balanced child keeps the height
+        if (cBalance == 0)
+            return;
+        p = g;
+        diff = nextDiff;
     }
+}
 
-    newNode = new AVLNode<Key, Value>(new_item.first, new_item.second, p);
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::nodeSwap(NodeT *n1, NodeT *n2)
+{
+    BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::nodeSwap(n1, n2);
+    int8_t tempB = n1->getBalance();
+    n1->setBalance(n2->getBalance());
+    n2->setBalance(tempB);
+}
 
-    // @condition Determine direction of child and set new parent
-    if (!setLeftChild)
-    {
-        p->setRight(newNode);
-    }
-    else
-    {
-        p->setLeft(newNode);
-    }
+/**
+ * Moves every item of greater into this tree in O(log n), leaving greater
+ * empty. All keys in greater must be larger than all keys in this tree;
+ * otherwise std::invalid_argument is thrown and neither tree is changed.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::join(AVLTree &greater)
+{
+    static_assert(!Alloc::bulk_release, "join moves nodes between trees, so Alloc must not own them");
+    if (!this->empty() && !greater.empty() &&
+        !this->comp_(this->getLargestNode()->getKey(), greater.getSmallestNode()->getKey()))
+        throw std::invalid_argument("join: keys are not all smaller than greater's keys");
+
+    int h1, h2, h;
+    NodeT *t1 = detachTree(h1);
+    NodeT *t2 = greater.detachTree(h2);
+    attachTree(joinNodes(t1, h1, t2, h2, h));
+}
 
-    // @summary Rebalance tree
-    if (newNode == nullptr)
-        return;
-    updateBalances(newNode->getParent());
+/**
+ * Moves every item whose key is not less than key into greater, in
+ * O(log n). Whatever greater held before is cleared first.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::split(const Key &key, AVLTree &greater)
+{
+    static_assert(!Alloc::bulk_release, "split moves nodes between trees, so Alloc must not own them");
+    greater.clear();
+
+    int ht, hl, hr;
+    NodeT *t = detachTree(ht);
+    NodeT *l, *r;
+    NodeT *mid = splitNodes(t, ht, key, l, hl, r, hr);
+
+    // @condition key itself goes to greater, in front of everything else there
+    if (mid != nullptr)
+        r = joinNodes(nullptr, 0, mid, r, hr, hr);
+    attachTree(l);
+    greater.attachTree(r);
+}
+
+/**
+ * Adds every item of other whose key is not already in this tree, in
+ * O(m log(n/m + 1)) work for trees of sizes m <= n, spread over pool.
+ * Where both trees hold a key, this tree's value is kept. other is left empty.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::set_union(AVLTree &other, ThreadPool &pool)
+{
+    static_assert(!Alloc::bulk_release, "set_union moves nodes between trees, so Alloc must not own them");
+    int h1, h2, h;
+    NodeT *t1 = detachTree(h1);
+    NodeT *t2 = other.detachTree(h2);
+    attachTree(unionNodes(t1, h1, t2, h2, h, pool));
+}
+
+/**
+ * Keeps only the items whose keys are also in other, in the same bounds
+ * as set_union. other is left empty.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::set_intersection(AVLTree &other, ThreadPool &pool)
+{
+    static_assert(!Alloc::bulk_release, "set_intersection moves nodes between trees, so Alloc must not own them");
+    int h1, h2, h;
+    NodeT *t1 = detachTree(h1);
+    NodeT *t2 = other.detachTree(h2);
+    attachTree(intersectNodes(t1, h1, t2, h2, h, pool));
+}
+
+/**
+ * Removes every item whose key is in other, in the same bounds as
+ * set_union. other is left empty.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::set_difference(AVLTree &other, ThreadPool &pool)
+{
+    static_assert(!Alloc::bulk_release, "set_difference moves nodes between trees, so Alloc must not own them");
+    int h1, h2, h;
+    NodeT *t1 = detachTree(h1);
+    NodeT *t2 = other.detachTree(h2);
+    attachTree(differenceNodes(t1, h1, t2, h2, h, pool));
+}
+
+/**
+ * Returns the height of n's subtree in O(log n), by following the
+ * taller child that each balance factor points to.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+int AVLTree<Key, Value, Compare, NodeT, Alloc>::subtreeHeight(NodeT *n)
+{
+    int h = 0;
+    for (; n != nullptr; h++)
+        n = (n->getBalance() < 0) ? n->getLeft() : n->getRight();
+    return h;
+}
+
+/**
+ * Cuts t (of height ht) off from its children, which become detached
+ * subtrees l and r. Their heights follow from t's balance.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::detachChildren(NodeT *t, int ht, NodeT *&l, int &hl, NodeT *&r, int &hr)
+{
+    l = t->getLeft();
+    r = t->getRight();
+    hl = (t->getBalance() > 0) ? ht - 2 : ht - 1;
+    hr = (t->getBalance() < 0) ? ht - 2 : ht - 1;
+    if (l != nullptr)
+        l->setParent(nullptr);
+    if (r != nullptr)
+        r->setParent(nullptr);
+}
 
-    AVLNode<Key, Value> *cursorNode = newNode->getParent();
-    rebalanceTree(ancestor, newNode, root);
+/**
+ * Takes the whole tree out as a detached subtree, leaving this tree empty.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::detachTree(int &h)
+{
+    NodeT *t = this->root_;
+    h = subtreeHeight(t);
+    this->root_ = nullptr;
+    this->first_ = nullptr;
+    this->last_ = nullptr;
+    return t;
 }
 
-template <class Key, class Value>
-void AVLTree<Key, Value>::rebalanceTree(AVLNode<Key, Value> *ancestor, AVLNode<Key, Value> *newNode, AVLNode<Key, Value> *root)
+/**
+ * Makes the detached subtree t the (empty) tree's contents. Threaded nodes
+ * are relinked in one in-order pass, as the subtree operations leave their
+ * threads stale.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::attachTree(NodeT *t)
 {
+    this->root_ = t;
+    if (t == nullptr)
+        return;
+
+    NodeT *n = t;
+    while (n->getRight() != nullptr)
+        n = n->getRight();
+    this->last_ = n;
 
-    // Case 1: All subtrees are balanced
-    if (ancestor == NULL)
+    if constexpr (NodeT::threaded)
     {
-        if (newNode->getKey() < root->getKey())
+        NodeT *prev = nullptr;
+        n = t;
+        while (n->getLeft() != nullptr)
+            n = n->getLeft();
+        while (n != nullptr)
         {
-            root->setBalance(-1);
+            n->setPrev(prev);
+            if (prev != nullptr)
+                prev->setNext(n);
+            else
+                this->first_ = n;
+            prev = n;
+
+            // @summary Step in order through parent links, since the threads are stale
+            if (n->getRight() != nullptr)
+            {
+                n = n->getRight();
+                while (n->getLeft() != nullptr)
+                    n = n->getLeft();
+            }
+            else
+            {
+                while (n->getParent() != nullptr && n->getParent()->getRight() == n)
+                    n = n->getParent();
+                n = n->getParent();
+            }
         }
-        else
-            root->setBalance(1);
-        updateBalances(newNode);
+        prev->setNext(nullptr);
     }
+}
+
+/**
+ * Joins l, k and r into one tree, given that l's keys < k's key < r's keys,
+ * and returns it with its height h. k is a single detached node. If the
+ * heights differ by more than one, k is hung on the taller tree's spine at
+ * the first subtree no more than one taller than the other tree, and the
+ * spine is retraced as after an insert, in O(|hl - hr| + 1).
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::joinNodes(NodeT *l, int hl, NodeT *k, NodeT *r, int hr, int &h)
+{
+    std::size_t size = this->subtreeSize(l) + this->subtreeSize(r) + 1;
 
-    // Case 2: Insertion in opposite subtree of ancestor's BF
-    else if ((ancestor->getBalance() < 0) && (newNode->getKey() > ancestor->getKey()) ||
-             ((ancestor->getBalance() > 0) && (newNode->getKey() < ancestor->getKey())))
+    // @condition Close enough in height: k simply becomes the root
+    if (hl <= hr + 1 && hr <= hl + 1)
     {
-        ancestor->setBalance(0);
-        updateBalances(newNode);
+        k->setParent(nullptr);
+        k->setLeft(l);
+        k->setRight(r);
+        if (l != nullptr)
+            l->setParent(k);
+        if (r != nullptr)
+            r->setParent(k);
+        k->setBalance(hr - hl);
+        k->setSubtreeSize(size);
+        h = std::max(hl, hr) + 1;
+        return k;
     }
 
-    // Case 3: ancestor is right heavy and node inserted is in the right subtree of ancestor's left child
-    else if ((ancestor->getBalance() > 0) && (newNode->getKey() > ancestor->getRight()->getKey()))
+    // @summary Walk down the taller tree's inner spine to a subtree c of height hr or hl (+1)
+    bool right = hl > hr;
+    NodeT *top = right ? l : r;
+    NodeT *p = nullptr;
+    NodeT *c = top;
+    int hc = right ? hl : hr;
+    int hOther = right ? hr : hl;
+    while (hc > hOther + 1)
     {
-        ancestor->setBalance(0);
-        leftRotation(ancestor);
-        updateBalances(newNode);
+        p = c;
+        if (right)
+        {
+            hc -= (c->getBalance() < 0) ? 2 : 1;
+            c = c->getRight();
+        }
+        else
+        {
+            hc -= (c->getBalance() > 0) ? 2 : 1;
+            c = c->getLeft();
+        }
     }
-    // Case 4: ancestor is left heavy and node inserted is in the left subtree of ancestor's left child
-    else if ((ancestor->getBalance() < 0) && (newNode->getKey() < ancestor->getLeft()->getKey()))
+
+    // @summary k takes c's place, with c and the shorter tree as its children
+    NodeT *shorter = right ? r : l;
+    k->setLeft(right ? c : l);
+    k->setRight(right ? r : c);
+    if (c != nullptr)
+        c->setParent(k);
+    if (shorter != nullptr)
+        shorter->setParent(k);
+    k->setBalance(right ? hOther - hc : hc - hOther);
+    k->setSubtreeSize(this->subtreeSize(c) + this->subtreeSize(shorter) + 1);
+    k->setParent(p);
+    if (right)
+        p->setRight(k);
+    else
+        p->setLeft(k);
+    this->adjustSubtreeSizes(p, this->subtreeSize(shorter) + 1);
+
+    // @summary c's place grew by one level; rotations may lift a new node above top
+    bool grew = insertFix(p, k);
+    while (top->getParent() != nullptr)
+        top = top->getParent();
+    h = std::max(hl, hr) + (grew ? 1 : 0);
+    return top;
+}
+
+/**
+ * Joins l and r, given that l's keys < r's keys, by taking the largest
+ * node out of l to join them with.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::joinNodes(NodeT *l, int hl, NodeT *r, int hr, int &h)
+{
+    if (l == nullptr)
     {
-        ancestor->setBalance(0);
-        rightRotation(ancestor->getLeft());
-        updateBalances(newNode);
+        h = hr;
+        return r;
     }
+    NodeT *k;
+    int hRest;
+    NodeT *rest = splitLast(l, hl, k, hRest);
+    return joinNodes(rest, hRest, k, r, hr, h);
+}
 
-    // Case 5: ancestor is left heavy and node inserted is in the right subtree of ancestor's left child
-    else if ((ancestor->getBalance() < 0) && (newNode->getKey() > ancestor->getLeft()->getKey()))
+/**
+ * Splits t into l, holding the keys less than key, and r, holding the
+ * greater ones, in O(log n). Returns the detached node holding key, if any.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::splitNodes(NodeT *t, int ht, const Key &key, NodeT *&l, int &hl, NodeT *&r, int &hr)
+{
+    if (t == nullptr)
     {
-        // Perform double right rotation (actually a left followed by a right)
-        rightRotation(ancestor->getLeft());
-        rightRotation(ancestor);
-        updateBalances(newNode);
+        l = r = nullptr;
+        hl = hr = 0;
+        return nullptr;
     }
 
-    //--------------------------------------------------------------------------------
-    // Case 6: ancestor.balanceFactor is 'R' and the node inserted is
-    //      in the left subtree of ancestor's right child
-    //--------------------------------------------------------------------------------
-    else
+    NodeT *tl, *tr;
+    int htl, htr;
+    detachChildren(t, ht, tl, htl, tr, htr);
+
+    // @condition key is left of t: split the left subtree, and rejoin its upper part with t and tr
+    if (this->comp_(key, t->getKey()))
+    {
+        NodeT *upper;
+        int hUpper;
+        NodeT *mid = splitNodes(tl, htl, key, l, hl, upper, hUpper);
+        r = joinNodes(upper, hUpper, t, tr, htr, hr);
+        return mid;
+    }
+    // @condition key is right of t: the mirror image
+    if (this->comp_(t->getKey(), key))
     {
-        // Perform double left rotation (actually a right followed by a left)
-        rightRotation(ancestor->getRight());
-        leftRotation(ancestor);
-        updateBalances(newNode);
+        NodeT *lower;
+        int hLower;
+        NodeT *mid = splitNodes(tr, htr, key, lower, hLower, r, hr);
+        l = joinNodes(tl, htl, t, lower, hLower, hl);
+        return mid;
     }
+    l = tl;
+    hl = htl;
+    r = tr;
+    hr = htr;
+    return t;
 }
 
-// @summary Retrieve the height of the tree from node n
-template <class Key, class Value>
-int AVLTree<Key, Value>::getHeight(AVLNode<Key, Value> *n)
+/**
+ * Takes the largest node out of t (as last), returning the rest with its height h.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::splitLast(NodeT *t, int ht, NodeT *&last, int &h)
 {
-    int lSubtreeHeight, rSubstreeHeight;
-    int finalHeight = 0;
-
-    // @summary Traverse up to right and keep track of subtree heights
-    if (n != nullptr)
+    NodeT *tl, *tr;
+    int htl, htr;
+    detachChildren(t, ht, tl, htl, tr, htr);
+    if (tr == nullptr)
     {
-        lSubtreeHeight = getHeight(n->getLeft());
-        rSubstreeHeight = getHeight(n->getRight());
-        finalHeight = std::max(lSubtreeHeight, rSubstreeHeight) + 1;
+        last = t;
+        h = htl;
+        return tl;
     }
-    return finalHeight;
+    int hRest;
+    NodeT *rest = splitLast(tr, htr, last, hRest);
+    return joinNodes(tl, htl, t, rest, hRest, h);
 }
 
-// @summary Calculate the balance of subtrees at node n
-template <class Key, class Value>
-int AVLTree<Key, Value>::calculateBalance(AVLNode<Key, Value> *n)
+/**
+ * Runs f and g on pool when there is enough work to pay for it, else inline.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename F, typename G>
+void AVLTree<Key, Value, Compare, NodeT, Alloc>::forkJoin(ThreadPool &pool, std::size_t work, F &&f, G &&g)
 {
-    // If no subtree, that subtree's height is 0
-    int lHeight = n->getLeft() != nullptr ? this->getHeight(n->getLeft()) : 0;
-    int rHeight = n->getRight() != nullptr ? this->getHeight(n->getRight()) : 0;
-    return (rHeight - lHeight);
+    if (work >= 4096)
+    {
+        pool.fork_join(f, g);
+    }
+    else
+    {
+        f();
+        g();
+    }
 }
 
-// @summary Helper function to rotate right
-template <class Key, class Value>
-AVLNode<Key, Value> *AVLTree<Key, Value>::rightRotation(AVLNode<Key, Value> *n)
+/**
+ * Union of t1 and t2: split t2 around t1's root, take the unions of the
+ * matching halves in parallel, and join them back around t1's root.
+ * t2's copy of a key in both trees is destroyed.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::unionNodes(NodeT *t1, int h1, NodeT *t2, int h2, int &h, ThreadPool &pool)
 {
-    AVLNode<Key, Value> *currLeft = n->getLeft();
-    AVLNode<Key, Value> *currLeft_RightChild = currLeft->getRight();
-
-    // @summary Move current node down, set left node equal to the right child of the child node (could be null)
-    currLeft->setRight(n);
-    n->setLeft(currLeft_RightChild);
-
-    // @summary Rebalance
-    n->setBalance(std::max(this->getHeight(n->getLeft()), this->getHeight(n->getRight())) + 1);
-    currLeft->setBalance(std::max(this->getHeight(currLeft->getLeft()), this->getHeight(currLeft->getRight())) + 1);
+    if (t1 == nullptr || t2 == nullptr)
+    {
+        h = (t1 == nullptr) ? h2 : h1;
+        return (t1 == nullptr) ? t2 : t1;
+    }
 
-    // Return new root
-    return n;
+    std::size_t work = t1->getSubtreeSize() + t2->getSubtreeSize();
+    NodeT *l1, *r1, *l2, *r2, *l, *r;
+    int hl1, hr1, hl2, hr2, hl, hr;
+    NodeT *dup = splitNodes(t2, h2, t1->getKey(), l2, hl2, r2, hr2);
+    detachChildren(t1, h1, l1, hl1, r1, hr1);
+    forkJoin(pool, work, [&]()
+             { l = unionNodes(l1, hl1, l2, hl2, hl, pool); },
+             [&]()
+             { r = unionNodes(r1, hr1, r2, hr2, hr, pool); });
+    if (dup != nullptr)
+        this->destroyNode(dup);
+    return joinNodes(l, hl, t1, r, hr, h);
 }
 
-// @summary Helper function to rotate left
-template <class Key, class Value>
-AVLNode<Key, Value> *AVLTree<Key, Value>::leftRotation(AVLNode<Key, Value> *n)
+/**
+ * Intersection of t1 and t2, split the same way as the union. t1's root
+ * stays only if t2 also holds its key; every other node is destroyed.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::intersectNodes(NodeT *t1, int h1, NodeT *t2, int h2, int &h, ThreadPool &pool)
 {
-    AVLNode<Key, Value> *currRight = n->getRight();
-    AVLNode<Key, Value> *currRight_LeftChild = currRight->getLeft();
-
-    // @summary Move current node down, set right node equal to the left child of the child node (could be null)
-    currRight->setLeft(n);
-    n->setRight(currRight_LeftChild);
-
-    // @summary Rebalance
-    n->setBalance(std::max(this->getHeight(n->getLeft()), this->getHeight(n->getRight())) + 1);
-    currRight->setBalance(std::max(this->getHeight(currRight->getLeft()), this->getHeight(currRight->getRight())) + 1);
+    if (t1 == nullptr || t2 == nullptr)
+    {
+        this->clearSubtree(t1);
+        this->clearSubtree(t2);
+        h = 0;
+        return nullptr;
+    }
 
-    // Return new root
-    return n;
+    std::size_t work = t1->getSubtreeSize() + t2->getSubtreeSize();
+    NodeT *l1, *r1, *l2, *r2, *l, *r;
+    int hl1, hr1, hl2, hr2, hl, hr;
+    NodeT *dup = splitNodes(t2, h2, t1->getKey(), l2, hl2, r2, hr2);
+    detachChildren(t1, h1, l1, hl1, r1, hr1);
+    forkJoin(pool, work, [&]()
+             { l = intersectNodes(l1, hl1, l2, hl2, hl, pool); },
+             [&]()
+             { r = intersectNodes(r1, hr1, r2, hr2, hr, pool); });
+    if (dup == nullptr)
+    {
+        this->destroyNode(t1);
+        return joinNodes(l, hl, r, hr, h);
+    }
+    this->destroyNode(dup);
+    return joinNodes(l, hl, t1, r, hr, h);
 }
 
-/*
- * Recall: The writeup specifies that if a node has 2 children you
- * should swap with the predecessor and then remove.
+/**
+ * Difference t1 - t2: split t1 around t2's root, take the differences of
+ * the matching halves in parallel, and join them without t2's root key.
  */
-template <class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key &key)
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *AVLTree<Key, Value, Compare, NodeT, Alloc>::differenceNodes(NodeT *t1, int h1, NodeT *t2, int h2, int &h, ThreadPool &pool)
 {
-    // TODO
-}
+    if (t1 == nullptr || t2 == nullptr)
+    {
+        this->clearSubtree(t2);
+        h = h1;
+        return t1;
+    }
 
-template <class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap(AVLNode<Key, Value> *n1, AVLNode<Key, Value> *n2)
-{
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
-    int8_t tempB = n1->getBalance();
-    n1->setBalance(n2->getBalance());
-    n2->setBalance(tempB);
+    std::size_t work = t1->getSubtreeSize() + t2->getSubtreeSize();
+    NodeT *l1, *r1, *l2, *r2, *l, *r;
+    int hl1, hr1, hl2, hr2, hl, hr;
+    NodeT *dup = splitNodes(t1, h1, t2->getKey(), l1, hl1, r1, hr1);
+    detachChildren(t2, h2, l2, hl2, r2, hr2);
+    forkJoin(pool, work, [&]()
+             { l = differenceNodes(l1, hl1, l2, hl2, hl, pool); },
+             [&]()
+             { r = differenceNodes(r1, hr1, r2, hr2, hr, pool); });
+    this->destroyNode(t2);
+    if (dup != nullptr)
+        this->destroyNode(dup);
+    return joinNodes(l, hl, r, hr, h);
 }
 
 #endif
@@ -0,0 +1,508 @@
+// Benchmark for BinarySearchTree, AVLTree and BTree, with std::map as a baseline.
+//
+// Usage: ./bst-bench [max_n]
+//
+// For every tree, key distribution and size (10^3 up to max_n, default 10^6)
+// this measures insert, find, remove, full in-order iteration and clear,
+// reporting throughput, per-operation latency percentiles and, where the
+// kernel allows it, cache and branch misses per operation (perf_event_open).
+// The "avl" batch row looks the find phase's keys up with find_batch.
+// "avl-frozen" is an AVLTree compiled by freeze(), so it only has find and
+// iterate; "avl-eytzinger" is an EytzingerIndex over one, with find and
+// find_batch. "avl-compact" is a CompactAVLTree, with 32-bit index links,
+// and "avl-parentless" a ParentlessAVLTree, without parent pointers.
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "btree.h"
+#include "compact_avlbst.h"
+#include "parentless_avlbst.h"
+#include "eytzinger_index.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Unbalanced trees degenerate into a path on sorted-like input; cap those runs
+static const size_t DEGENERATE_BST_LIMIT = 20000;
+
+/*
+  -----------------------------------------
+  Hardware counters
+  -----------------------------------------
+*/
+
+/**
+ * Cache and branch misses of the calling thread, read as one perf event group.
+ * Falls back to reporting nothing when perf_event_open is unavailable.
+ */
+class PerfCounters
+{
+public:
+    PerfCounters();
+    ~PerfCounters();
+    bool available() const { return leader_ >= 0; }
+    void start();
+    void stop(uint64_t &cacheMisses, uint64_t &branchMisses);
+
+private:
+    int open(uint64_t config, int group);
+    int leader_;
+    int branch_;
+};
+
+#ifdef __linux__
+int PerfCounters::open(uint64_t config, int group)
+{
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = (group < 0) ? 1 : 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+PerfCounters::PerfCounters() : leader_(-1), branch_(-1)
+{
+    leader_ = open(PERF_COUNT_HW_CACHE_MISSES, -1);
+    if (leader_ < 0)
+        return;
+    branch_ = open(PERF_COUNT_HW_BRANCH_MISSES, leader_);
+    if (branch_ < 0)
+    {
+        close(leader_);
+        leader_ = -1;
+    }
+}
+
+PerfCounters::~PerfCounters()
+{
+    if (branch_ >= 0)
+        close(branch_);
+    if (leader_ >= 0)
+        close(leader_);
+}
+
+void PerfCounters::start()
+{
+    if (!available())
+        return;
+    ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters::stop(uint64_t &cacheMisses, uint64_t &branchMisses)
+{
+    cacheMisses = branchMisses = 0;
+    if (!available())
+        return;
+    ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t values[3] = {0, 0, 0}; // count, cache misses, branch misses
+    if (read(leader_, values, sizeof(values)) == (ssize_t)sizeof(values))
+    {
+        cacheMisses = values[1];
+        branchMisses = values[2];
+    }
+}
+#else
+PerfCounters::PerfCounters() : leader_(-1), branch_(-1) {}
+PerfCounters::~PerfCounters() {}
+void PerfCounters::start() {}
+void PerfCounters::stop(uint64_t &cacheMisses, uint64_t &branchMisses) { cacheMisses = branchMisses = 0; }
+#endif
+
+/*
+  -----------------------------------------
+  Key distributions
+  -----------------------------------------
+*/
+
+enum Distribution
+{
+    SEQUENTIAL,  // 0, 1, 2, ...
+    RANDOM,      // a uniform shuffle of 0..n-1
+    ZIPFIAN,     // n draws from 0..n-1 with Zipf(0.99) popularity, hot keys scattered
+    ADVERSARIAL  // 0, n-1, 1, n-2, ...: degenerates an unbalanced BST into a path
+};
+
+static const char *distributionName(Distribution d)
+{
+    switch (d)
+    {
+    case SEQUENTIAL:
+        return "sequential";
+    case RANDOM:
+        return "random";
+    case ZIPFIAN:
+        return "zipfian";
+    default:
+        return "adversarial";
+    }
+}
+
+static vector<int> makeKeys(Distribution d, size_t n, mt19937_64 &rng)
+{
+    vector<int> keys(n);
+    if (d == SEQUENTIAL || d == RANDOM)
+    {
+        for (size_t i = 0; i < n; i++)
+            keys[i] = (int)i;
+        if (d == RANDOM)
+            shuffle(keys.begin(), keys.end(), rng);
+    }
+    else if (d == ADVERSARIAL)
+    {
+        for (size_t i = 0; i < n; i++)
+            keys[i] = (int)((i % 2 == 0) ? i / 2 : n - 1 - i / 2);
+    }
+    else
+    {
+        // @summary Invert the Zipf CDF; a shuffled rank->key map scatters the hot keys
+        vector<double> cdf(n);
+        double sum = 0;
+        for (size_t r = 0; r < n; r++)
+        {
+            sum += 1.0 / pow((double)(r + 1), 0.99);
+            cdf[r] = sum;
+        }
+        vector<int> keyOfRank(n);
+        for (size_t r = 0; r < n; r++)
+            keyOfRank[r] = (int)r;
+        shuffle(keyOfRank.begin(), keyOfRank.end(), rng);
+        uniform_real_distribution<double> u(0, sum);
+        for (size_t i = 0; i < n; i++)
+        {
+            size_t r = lower_bound(cdf.begin(), cdf.end(), u(rng)) - cdf.begin();
+            keys[i] = keyOfRank[min(r, n - 1)];
+        }
+    }
+    return keys;
+}
+
+/*
+  -----------------------------------------
+  Tree adapters
+  -----------------------------------------
+*/
+
+template <typename Tree>
+struct SearchTreeAdapter
+{
+    Tree tree;
+    void insert(int k) { tree.insert(std::make_pair(k, k)); }
+    bool find(int k) const { return tree.find(k) != tree.end(); }
+    void remove(int k) { tree.remove(k); }
+    long iterate() const
+    {
+        long sum = 0;
+        for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it)
+            sum += it->second;
+        return sum;
+    }
+    void clear() { tree.clear(); }
+};
+
+struct MapAdapter
+{
+    map<int, int> tree;
+    void insert(int k) { tree[k] = k; }
+    bool find(int k) const { return tree.find(k) != tree.end(); }
+    void remove(int k) { tree.erase(k); }
+    long iterate() const
+    {
+        long sum = 0;
+        for (map<int, int>::const_iterator it = tree.begin(); it != tree.end(); ++it)
+            sum += it->second;
+        return sum;
+    }
+    void clear() { tree.clear(); }
+};
+
+/*
+  -----------------------------------------
+  Measurement
+  -----------------------------------------
+*/
+
+static PerfCounters *counters = NULL;
+static volatile long sink = 0;
+
+/**
+ * Collects per-operation latencies and the counters of one benchmark phase.
+ */
+class Phase
+{
+public:
+    Phase(const char *op, size_t ops) : op_(op), ops_(ops), cacheMisses_(0), branchMisses_(0)
+    {
+        latencies_.reserve(ops);
+    }
+    void begin()
+    {
+        counters->start();
+        phaseStart_ = Clock::now();
+    }
+    void end()
+    {
+        elapsed_ = Clock::now() - phaseStart_;
+        counters->stop(cacheMisses_, branchMisses_);
+    }
+    void record(Clock::time_point opStart, Clock::time_point opEnd)
+    {
+        latencies_.push_back(chrono::duration_cast<chrono::nanoseconds>(opEnd - opStart).count());
+    }
+    void report(const char *tree, Distribution d, size_t n)
+    {
+        double seconds = chrono::duration<double>(elapsed_).count();
+        cout << left << setw(16) << tree << setw(13) << distributionName(d) << right << setw(9) << n
+             << "  " << left << setw(8) << op_ << right << fixed << setprecision(2)
+             << setw(9) << (ops_ / seconds / 1e6);
+        if (latencies_.empty())
+        {
+            cout << setw(8) << "-" << setw(8) << "-" << setw(8) << "-";
+        }
+        else
+        {
+            sort(latencies_.begin(), latencies_.end());
+            cout << setw(8) << percentile(0.50) << setw(8) << percentile(0.99) << setw(8) << percentile(0.999);
+        }
+        if (counters->available())
+            cout << setw(10) << (double)cacheMisses_ / ops_ << setw(10) << (double)branchMisses_ / ops_;
+        else
+            cout << setw(10) << "n/a" << setw(10) << "n/a";
+        cout << endl;
+    }
+
+private:
+    long percentile(double p) const
+    {
+        return latencies_[min(latencies_.size() - 1, (size_t)(p * latencies_.size()))];
+    }
+
+    const char *op_;
+    size_t ops_;
+    vector<long> latencies_;
+    Clock::time_point phaseStart_;
+    Clock::duration elapsed_;
+    uint64_t cacheMisses_;
+    uint64_t branchMisses_;
+};
+
+/**
+ * Runs every phase on a fresh tree: insert all keys, find them in a fresh
+ * draw of the same distribution, iterate, remove the first half of the
+ * inserted keys, then clear what is left. Latencies include one clock read.
+ */
+template <typename Adapter>
+void runBenchmark(const char *name, Distribution d, size_t n, const vector<int> &keys, const vector<int> &probes)
+{
+    Adapter a;
+
+    Phase insertPhase("insert", n);
+    insertPhase.begin();
+    for (size_t i = 0; i < n; i++)
+    {
+        Clock::time_point t0 = Clock::now();
+        a.insert(keys[i]);
+        insertPhase.record(t0, Clock::now());
+    }
+    insertPhase.end();
+    insertPhase.report(name, d, n);
+
+    Phase findPhase("find", n);
+    long found = 0;
+    findPhase.begin();
+    for (size_t i = 0; i < n; i++)
+    {
+        Clock::time_point t0 = Clock::now();
+        found += a.find(probes[i]);
+        findPhase.record(t0, Clock::now());
+    }
+    findPhase.end();
+    sink = sink + found;
+    findPhase.report(name, d, n);
+
+    Phase iteratePhase("iterate", n);
+    iteratePhase.begin();
+    sink = sink + a.iterate();
+    iteratePhase.end();
+    iteratePhase.report(name, d, n);
+
+    Phase removePhase("remove", n / 2);
+    removePhase.begin();
+    for (size_t i = 0; i < n / 2; i++)
+    {
+        Clock::time_point t0 = Clock::now();
+        a.remove(keys[i]);
+        removePhase.record(t0, Clock::now());
+    }
+    removePhase.end();
+    removePhase.report(name, d, n);
+
+    Phase clearPhase("clear", n - n / 2);
+    clearPhase.begin();
+    a.clear();
+    clearPhase.end();
+    clearPhase.report(name, d, n);
+}
+
+/**
+ * Runs find_batch over the same probes as runBenchmark's find phase, on a
+ * fresh tree holding keys, for comparison with finding them one by one.
+ */
+template <typename Tree>
+void runBatchBenchmark(const char *name, Distribution d, size_t n, const vector<int> &keys, const vector<int> &probes)
+{
+    Tree tree;
+    for (size_t i = 0; i < n; i++)
+        tree.insert(std::make_pair(keys[i], keys[i]));
+    vector<typename Tree::iterator> results;
+    results.reserve(n);
+
+    Phase batchPhase("batch", n);
+    batchPhase.begin();
+    tree.find_batch(probes, std::back_inserter(results));
+    batchPhase.end();
+    long found = 0;
+    for (size_t i = 0; i < n; i++)
+        found += results[i] != tree.end();
+    sink = sink + found;
+    batchPhase.report(name, d, n);
+}
+
+/**
+ * Runs the read-only phases on a frozen copy of an AVLTree holding keys:
+ * find in the same probes as runBenchmark, then iterate.
+ */
+void runFrozenBenchmark(const char *name, Distribution d, size_t n, const vector<int> &keys, const vector<int> &probes)
+{
+    AVLTree<int, int> source;
+    for (size_t i = 0; i < n; i++)
+        source.insert(std::make_pair(keys[i], keys[i]));
+    FrozenTree<int, int> frozen = source.freeze();
+
+    Phase findPhase("find", n);
+    long found = 0;
+    findPhase.begin();
+    for (size_t i = 0; i < n; i++)
+    {
+        Clock::time_point t0 = Clock::now();
+        found += frozen.find(probes[i]) != frozen.end();
+        findPhase.record(t0, Clock::now());
+    }
+    findPhase.end();
+    sink = sink + found;
+    findPhase.report(name, d, n);
+
+    Phase iteratePhase("iterate", n);
+    long sum = 0;
+    iteratePhase.begin();
+    for (FrozenTree<int, int>::iterator it = frozen.begin(); it != frozen.end(); ++it)
+        sum += it->second;
+    iteratePhase.end();
+    sink = sink + sum;
+    iteratePhase.report(name, d, n);
+}
+
+/**
+ * Runs finds on an EytzingerIndex built from an AVLTree holding keys: one
+ * at a time, then all probes through find_batch.
+ */
+void runEytzingerBenchmark(const char *name, Distribution d, size_t n, const vector<int> &keys, const vector<int> &probes)
+{
+    AVLTree<int, int> source;
+    for (size_t i = 0; i < n; i++)
+        source.insert(std::make_pair(keys[i], keys[i]));
+    EytzingerIndex<int, int> index(source);
+
+    Phase findPhase("find", n);
+    long found = 0;
+    findPhase.begin();
+    for (size_t i = 0; i < n; i++)
+    {
+        Clock::time_point t0 = Clock::now();
+        found += index.find(probes[i]) != index.end();
+        findPhase.record(t0, Clock::now());
+    }
+    findPhase.end();
+    findPhase.report(name, d, n);
+
+    vector<size_t> slots(n);
+    Phase batchPhase("batch", n);
+    batchPhase.begin();
+    index.find_batch(probes.data(), n, slots.data());
+    batchPhase.end();
+    for (size_t i = 0; i < n; i++)
+        found += slots[i] != index.end();
+    sink = sink + found;
+    batchPhase.report(name, d, n);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t maxN = 1000000;
+    if (argc > 1)
+        maxN = strtoul(argv[1], NULL, 10);
+
+    PerfCounters perf;
+    counters = &perf;
+    if (!perf.available())
+        cout << "(hardware counters unavailable; perf_event_open failed)" << endl;
+
+    cout << left << setw(16) << "tree" << setw(13) << "keys" << right << setw(9) << "n"
+         << "  " << left << setw(8) << "op" << right << setw(9) << "Mops/s"
+         << setw(8) << "p50ns" << setw(8) << "p99ns" << setw(8) << "p999ns"
+         << setw(10) << "cmiss/op" << setw(10) << "bmiss/op" << endl;
+
+    mt19937_64 rng(42);
+    const Distribution distributions[] = {SEQUENTIAL, RANDOM, ZIPFIAN, ADVERSARIAL};
+    for (size_t n = 1000; n <= maxN; n *= 10)
+    {
+        for (size_t di = 0; di < sizeof(distributions) / sizeof(distributions[0]); di++)
+        {
+            Distribution d = distributions[di];
+            vector<int> keys = makeKeys(d, n, rng);
+            vector<int> probes = makeKeys(d == SEQUENTIAL ? SEQUENTIAL : (d == ZIPFIAN ? ZIPFIAN : RANDOM), n, rng);
+
+            bool degenerate = (d == SEQUENTIAL || d == ADVERSARIAL);
+            if (!degenerate || n <= DEGENERATE_BST_LIMIT)
+                runBenchmark<SearchTreeAdapter<BinarySearchTree<int, int> > >("bst", d, n, keys, probes);
+            runBenchmark<SearchTreeAdapter<AVLTree<int, int> > >("avl", d, n, keys, probes);
+            runBatchBenchmark<AVLTree<int, int> >("avl", d, n, keys, probes);
+            runBenchmark<SearchTreeAdapter<AVLTree<int, int, std::less<int>, AVLNode<int, int>, NodePool<AVLNode<int, int> > > > >(
+                "avl-pool", d, n, keys, probes);
+            runBenchmark<SearchTreeAdapter<AVLTree<int, int, std::less<int>, AVLNode<int, int, true> > > >(
+                "avl-threaded", d, n, keys, probes);
+            runBenchmark<SearchTreeAdapter<CompactAVLTree<int, int> > >("avl-compact", d, n, keys, probes);
+            runBenchmark<SearchTreeAdapter<ParentlessAVLTree<int, int> > >("avl-parentless", d, n, keys, probes);
+            runFrozenBenchmark("avl-frozen", d, n, keys, probes);
+            runEytzingerBenchmark("avl-eytzinger", d, n, keys, probes);
+            runBenchmark<SearchTreeAdapter<BTree<int, int> > >("btree", d, n, keys, probes);
+            runBenchmark<MapAdapter>("std::map", d, n, keys, probes);
+        }
+    }
+    return 0;
+}
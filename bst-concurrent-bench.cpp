@@ -0,0 +1,178 @@
+// Multi-threaded throughput benchmark for ConcurrentAVLTree, with an AVLTree
+// behind a global mutex and behind a global reader-writer lock as baselines.
+//
+// Usage: ./bst-concurrent-bench [n] [max_threads]
+//
+// Each tree is filled with n random keys from [0, 2n), then every thread
+// runs a mix of finds, inserts and removes of random keys in that range for
+// a fixed time. Reported is the total throughput over all threads, for
+// 1, 2, 4, ... up to max_threads threads (default: twice the hardware threads).
+
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+#include "avlbst.h"
+#include "concurrent_avlbst.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+static const chrono::milliseconds RUN_TIME(300);
+
+/*
+  -----------------------------------------
+  Tree adapters
+  -----------------------------------------
+*/
+
+struct MutexAdapter
+{
+    AVLTree<int, int> tree;
+    mutex lock;
+    bool find(int k)
+    {
+        lock_guard<mutex> guard(lock);
+        return tree.find(k) != tree.end();
+    }
+    void insert(int k)
+    {
+        lock_guard<mutex> guard(lock);
+        tree.insert(std::make_pair(k, k));
+    }
+    void remove(int k)
+    {
+        lock_guard<mutex> guard(lock);
+        tree.remove(k);
+    }
+};
+
+struct RWLockAdapter
+{
+    AVLTree<int, int> tree;
+    shared_mutex lock;
+    bool find(int k)
+    {
+        shared_lock<shared_mutex> guard(lock);
+        return tree.find(k) != tree.end();
+    }
+    void insert(int k)
+    {
+        lock_guard<shared_mutex> guard(lock);
+        tree.insert(std::make_pair(k, k));
+    }
+    void remove(int k)
+    {
+        lock_guard<shared_mutex> guard(lock);
+        tree.remove(k);
+    }
+};
+
+struct ConcurrentAdapter
+{
+    ConcurrentAVLTree<int, int> tree;
+    bool find(int k) { return tree.contains(k); }
+    void insert(int k) { tree.insert(std::make_pair(k, k)); }
+    void remove(int k) { tree.remove(k); }
+};
+
+/*
+  -----------------------------------------
+  Measurement
+  -----------------------------------------
+*/
+
+static volatile long sink = 0;
+
+/**
+ * Runs threads workers on a tree prefilled with n keys for RUN_TIME, with
+ * readPercent of the operations finds and the rest split evenly between
+ * inserts and removes (so the size stays around n). Returns Mops/s.
+ */
+template <typename Adapter>
+double runMix(size_t n, unsigned threads, unsigned readPercent)
+{
+    Adapter a;
+    mt19937_64 rng(42);
+    for (size_t i = 0; i < n; i++)
+        a.insert(rng() % (2 * n));
+
+    atomic<bool> start(false), stop(false);
+    atomic<long> totalOps(0);
+    vector<thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.push_back(thread([&, t]()
+                                 {
+            mt19937_64 local(1000 + t);
+            long ops = 0, found = 0;
+            while (!start.load(memory_order_acquire))
+                this_thread::yield();
+            while (!stop.load(memory_order_relaxed))
+            {
+                // @summary Poll the stop flag only every 64 operations
+                for (int i = 0; i < 64; i++)
+                {
+                    uint64_t r = local();
+                    int key = (int)((r >> 8) % (2 * n));
+                    unsigned dice = r % 100;
+                    if (dice < readPercent)
+                        found += a.find(key);
+                    else if ((dice - readPercent) % 2 == 0)
+                        a.insert(key);
+                    else
+                        a.remove(key);
+                }
+                ops += 64;
+            }
+            totalOps += ops;
+            sink = sink + found; }));
+    }
+
+    Clock::time_point t0 = Clock::now();
+    start.store(true, memory_order_release);
+    this_thread::sleep_for(RUN_TIME);
+    stop.store(true);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    double seconds = chrono::duration<double>(Clock::now() - t0).count();
+    return totalOps.load() / seconds / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n = 1000000;
+    unsigned maxThreads = 2 * max(1u, thread::hardware_concurrency());
+    if (argc > 1)
+        n = strtoul(argv[1], NULL, 10);
+    if (argc > 2)
+        maxThreads = strtoul(argv[2], NULL, 10);
+
+    cout << "n = " << n << ", " << thread::hardware_concurrency() << " hardware threads" << endl;
+    cout << left << setw(16) << "tree" << right << setw(7) << "reads" << setw(9) << "threads"
+         << setw(10) << "Mops/s" << endl;
+
+    const unsigned readPercents[] = {100, 90, 50};
+    for (size_t ri = 0; ri < sizeof(readPercents) / sizeof(readPercents[0]); ri++)
+    {
+        unsigned reads = readPercents[ri];
+        for (unsigned threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            cout << fixed << setprecision(2);
+            cout << left << setw(16) << "avl+mutex" << right << setw(6) << reads << "%" << setw(9) << threads
+                 << setw(10) << runMix<MutexAdapter>(n, threads, reads) << endl;
+            cout << left << setw(16) << "avl+rwlock" << right << setw(6) << reads << "%" << setw(9) << threads
+                 << setw(10) << runMix<RWLockAdapter>(n, threads, reads) << endl;
+            cout << left << setw(16) << "concurrent-avl" << right << setw(6) << reads << "%" << setw(9) << threads
+                 << setw(10) << runMix<ConcurrentAdapter>(n, threads, reads) << endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,97 @@
+// Stress test for a BinarySearchTree degenerated into one long path.
+//
+// Usage: ./bst-stress [depth]
+//
+// Sorted inserts leave an unbalanced tree as a right-leaning path, one node
+// per level. This builds such a path of depth nodes (default 10^7), then
+// searches it, measures its height, iterates it and destroys it, timing
+// each step. None of them recurse, so none can run out of stack however
+// deep the path is. The path is linked directly rather than inserted:
+// every insert at its bottom walks it, so inserting would take O(n^2).
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include "bst.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+/**
+ * A BinarySearchTree that can be built as a path directly.
+ */
+class PathTree : public BinarySearchTree<int, int>
+{
+public:
+    /**
+     * Replaces the contents with keys 0 .. depth - 1, each the right child
+     * of the one before, as inserting them in order would. Built bottom up,
+     * so every subtree size is known when its node is made.
+     */
+    void buildPath(int depth)
+    {
+        clear();
+        Node<int, int> *below = NULL;
+        for (int key = depth - 1; key >= 0; key--)
+        {
+            Node<int, int> *n = createNode(NULL, key, key);
+            n->setRight(below);
+            n->setSubtreeSize(depth - key);
+            if (below != NULL)
+                below->setParent(n);
+            else
+                last_ = n;
+            below = n;
+        }
+        root_ = below;
+    }
+
+    int height() const
+    {
+        return getHeight(root_);
+    }
+};
+
+void report(const char *step, Clock::time_point start)
+{
+    cout << left << setw(10) << step << right << fixed << setprecision(3)
+         << setw(9) << chrono::duration<double>(Clock::now() - start).count() << " s" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int depth = 10000000;
+    if (argc > 1)
+        depth = atoi(argv[1]);
+
+    PathTree *tree = new PathTree;
+    Clock::time_point start = Clock::now();
+    tree->buildPath(depth);
+    report("build", start);
+
+    start = Clock::now();
+    bool foundDeepest = (tree->find(depth - 1) != tree->end());
+    bool foundMissing = (tree->find(depth) != tree->end());
+    report("find", start);
+
+    start = Clock::now();
+    int height = tree->height();
+    report("height", start);
+
+    start = Clock::now();
+    long long sum = 0;
+    for (BinarySearchTree<int, int>::iterator it = tree->begin(); it != tree->end(); ++it)
+        sum += it->second;
+    report("iterate", start);
+
+    start = Clock::now();
+    delete tree;
+    report("destroy", start);
+
+    cout << "depth " << depth << ": height " << height << ", found deepest: " << foundDeepest
+         << ", found missing: " << foundMissing << ", sum " << sum << endl;
+    bool ok = foundDeepest && !foundMissing && height == depth && sum == (long long)depth * (depth - 1) / 2;
+    return ok ? 0 : 1;
+}
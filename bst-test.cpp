@@ -1,7 +1,17 @@
 #include <iostream>
 #include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 #include "bst.h"
 #include "avlbst.h"
+#include "btree.h"
+#include "compact_avlbst.h"
+#include "parentless_avlbst.h"
+#include "eytzinger_index.h"
+#include "concurrent_avlbst.h"
+#include "persistent_avlbst.h"
 
 using namespace std;
 
@@ -25,6 +35,11 @@ int main(int argc, char *argv[])
     }
     cout << "Erasing b" << endl;
     bt.remove('b');
+    for (char c = 'c'; c <= 'h'; c++)
+        bt.insert(std::make_pair(c, c - 'a'));
+    TreeShape btShape = bt.shape();
+    cout << "Shape after sorted inserts: height " << btShape.height << ", nodes " << btShape.nodeCount
+         << ", max skew " << btShape.maxSkew << ", balanced " << bt.isBalanced() << endl;
 
     // AVL Tree Tests
     AVLTree<char,int> at;
@@ -44,5 +59,215 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    AVLTree<int, int> sat;
+    for (int i = 0; i < 1000; i++)
+        sat.insert(std::make_pair(i, i));
+    cout << "AVLTree balanced after 1000 sorted inserts: " << sat.isBalanced() << endl;
+    for (int i = 0; i < 1000; i += 3)
+        sat.remove(i);
+    cout << "AVLTree balanced after removing every third key: " << sat.isBalanced() << endl;
+    cout << "Found 3 after removal: " << (sat.find(3) != sat.end()) << endl;
+
+    // Bulk load from a sorted range
+    std::vector<std::pair<int, int> > sorted;
+    for (int i = 0; i < 1000; i++)
+        sorted.push_back(std::make_pair(i, i * i));
+    AVLTree<int, int> bat(sorted.begin(), sorted.end());
+    cout << "\nBulk-loaded AVLTree balanced: " << bat.isBalanced() << ", value at 30: " << bat[30] << endl;
+
+    // Order statistics
+    AVLTree<int, int>::iterator median = bat.select(bat.size() / 2);
+    cout << "Size " << bat.size() << ", median key " << median->first << ", rank of 250: " << bat.rank(250);
+    median += 100;
+    cout << ", 100 past median: " << median->first << endl;
+
+    // Range queries
+    AVLTree<int, int> evens;
+    for (int i = 0; i < 100; i += 2)
+        evens.insert(std::make_pair(i, i));
+    cout << "lower_bound(31) " << evens.lower_bound(31)->first << ", upper_bound(32) " << evens.upper_bound(32)->first
+         << ", floor(31) " << evens.floor(31)->first << ", count_range(10, 20) " << evens.count_range(10, 20) << endl;
+
+    // Threaded nodes
+    AVLTree<int, int, std::less<int>, AVLNode<int, int, true> > tt;
+    for (int i = 0; i < 10; i++)
+        tt.insert(std::make_pair((i * 7) % 10, i));
+    tt.remove(4);
+    cout << "Threaded AVLTree in order:";
+    for (AVLTree<int, int, std::less<int>, AVLNode<int, int, true> >::iterator it = tt.begin(); it != tt.end(); ++it)
+        cout << " " << it->first;
+    cout << endl;
+
+    // Reverse iteration
+    cout << "Evens descending from 10:";
+    for (AVLTree<int, int>::reverse_iterator it(evens.upper_bound(10)); it != evens.rend(); ++it)
+        cout << " " << it->first;
+    cout << endl;
+
+    // Heterogeneous lookup through a transparent comparator
+    AVLTree<std::string, int, std::less<> > st;
+    st.insert(std::make_pair(std::string("alpha"), 1));
+    st.insert(std::make_pair(std::string("beta"), 2));
+    cout << "Found beta by string_view: " << (st.find(std::string_view("beta")) != st.end()) << endl;
+
+    // Pooled node allocation
+    BinarySearchTree<int, int, std::less<int>, Node<int, int>, NodePool<Node<int, int> > > pt;
+    for (int i = 0; i < 1000; i++)
+        pt.insert(std::make_pair((i * 37) % 1000, i));
+    for (int i = 0; i < 1000; i += 2)
+        pt.remove(i);
+    for (int i = 0; i < 1000; i += 2)
+        pt.insert(std::make_pair(i, i));
+    int pooledCount = 0;
+    for (BinarySearchTree<int, int, std::less<int>, Node<int, int>, NodePool<Node<int, int> > >::iterator it = pt.begin(); it != pt.end(); ++it)
+        pooledCount++;
+    cout << "\nPooled BST count: " << pooledCount << endl;
+    pt.clear();
+    cout << "Pooled BST empty after clear: " << pt.empty() << endl;
+
+    // In-place insertion
+    AVLTree<std::string, std::string> words;
+    words.try_emplace("gamma", 3, 'g');
+    bool insertedAgain = words.try_emplace("gamma", "ignored").second;
+    words.insert_or_assign("delta", std::string("dd"));
+    words.emplace("alpha", "a");
+    words.insert(std::make_pair(std::string("beta"), std::string("b")));
+    cout << "\ntry_emplace on an existing key inserted: " << insertedAgain << endl;
+    for (AVLTree<std::string, std::string>::iterator it = words.begin(); it != words.end(); ++it)
+        cout << it->first << "=" << it->second << " ";
+    cout << endl;
+
+    // Hinted insertion of nearly sorted keys
+    AVLTree<int, int> stamps;
+    AVLTree<int, int>::iterator last = stamps.end();
+    for (int i = 0; i < 1000; i++)
+        last = stamps.insert(last, std::make_pair(i ^ 1, i)); // adjacent pairs swapped
+    cout << "\nHinted inserts: " << stamps.size() << " keys, balanced: " << stamps.isBalanced() << endl;
+
+    // Sorted batch merged into an existing tree
+    std::vector<std::pair<int, int> > batch;
+    for (int i = 500; i < 3000; i += 2)
+        batch.push_back(std::make_pair(i, -i));
+    stamps.insert_sorted_batch(batch.begin(), batch.end());
+    cout << "After sorted batch: " << stamps.size() << " keys, balanced: " << stamps.isBalanced()
+         << ", stamps[600] = " << stamps[600] << ", stamps[601] = " << stamps[601] << endl;
+
+    // Split, join and set operations
+    AVLTree<int, int> low, high, odds;
+    for (int i = 0; i < 20; i++)
+        low.insert(std::make_pair(i, i));
+    low.split(10, high);
+    cout << "\nSplit at 10: " << low.size() << " + " << high.size() << endl;
+    low.join(high);
+    for (int i = 1; i < 40; i += 2)
+        odds.insert(std::make_pair(i, -i));
+    low.set_difference(odds);
+    cout << "Evens below 20 after join and difference:";
+    for (AVLTree<int, int>::iterator it = low.begin(); it != low.end(); ++it)
+        cout << " " << it->first;
+    cout << ", balanced: " << low.isBalanced() << endl;
+
+    // Concurrent inserts and removes from several threads
+    ConcurrentAVLTree<int, int> shared;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++)
+        writers.push_back(std::thread([&shared, t]()
+                                      {
+            for (int i = t; i < 4000; i += 4)
+                shared.insert(std::make_pair(i, i));
+            for (int i = t; i < 4000; i += 8)
+                shared.remove(i); }));
+    for (size_t t = 0; t < writers.size(); t++)
+        writers[t].join();
+    int kept = 0;
+    shared.find(5, kept);
+    cout << "\nConcurrent tree: " << shared.size() << " keys, contains 8: " << shared.contains(8)
+         << ", value of 5: " << kept << ", balanced: " << shared.isBalanced() << endl;
+
+    // Snapshots of a persistent tree keep their contents while it changes
+    PersistentAVLTree<int, int> versioned;
+    for (int i = 0; i < 8; i++)
+        versioned.insert(std::make_pair(i, i));
+    PersistentAVLTree<int, int>::Snapshot before = versioned.snapshot();
+    versioned.remove(3);
+    versioned.insert(std::make_pair(5, 50));
+    cout << "\nSnapshot:";
+    for (PersistentAVLTree<int, int>::iterator it = before.begin(); it != before.end(); ++it)
+        cout << " " << it->first << "=" << it->second;
+    cout << "\nCurrent:";
+    for (PersistentAVLTree<int, int>::iterator it = versioned.begin(); it != versioned.end(); ++it)
+        cout << " " << it->first << "=" << it->second;
+    cout << ", balanced: " << versioned.isBalanced() << endl;
+
+    // A frozen copy answers the same queries from a contiguous layout
+    FrozenTree<int, int> frozen = stamps.freeze();
+    cout << "\nFrozen: " << frozen.size() << " keys, height " << frozen.height()
+         << ", first key >= 2001: " << frozen.lower_bound(2001)->first
+         << ", keys in [100, 200): " << frozen.count_range(100, 200)
+         << ", has 601: " << (frozen.find(601) != frozen.end()) << endl;
+
+    // The B-tree backend takes the same calls
+    BTree<char, int, 4> bbt;
+    for (char c = 'a'; c <= 'z'; c++)
+        bbt.insert(std::make_pair(c, c - 'a'));
+    for (char c = 'a'; c <= 'z'; c += 2)
+        bbt.remove(c);
+    bbt['z'] = 100;
+    cout << "\nBTree: " << bbt.size() << " keys, height " << bbt.height() << ", balanced: " << bbt.isBalanced() << ",";
+    for (BTree<char, int, 4>::iterator it = bbt.find('t'); it != bbt.end(); ++it)
+        cout << " " << it->first << "=" << it->second;
+    cout << endl;
+
+    // Batched lookups give the same answers as find
+    std::vector<int> wanted;
+    for (int i = 595; i < 605; i++)
+        wanted.push_back(i);
+    std::vector<AVLTree<int, int>::iterator> hits;
+    stamps.find_batch(wanted, std::back_inserter(hits));
+    cout << "\nfind_batch 595..604:";
+    for (size_t i = 0; i < hits.size(); i++)
+        cout << " " << (hits[i] == stamps.end() ? std::string("-") : std::to_string(hits[i]->second));
+    cout << endl;
+
+    // An Eytzinger index over the stamps, refreshed after an update
+    EytzingerIndex<int, int> index(stamps);
+    stamps.remove(600);
+    index.refresh(stamps);
+    int probes[] = {599, 600, 601, 2998, 5000};
+    std::size_t slots[5];
+    index.find_batch(probes, 5, slots);
+    cout << "\nEytzinger index: " << index.size() << " keys, first key >= 600: "
+         << index.keyAt(index.lower_bound(600)) << ", found:";
+    for (int i = 0; i < 5; i++)
+        cout << " " << (slots[i] != index.end());
+    cout << endl;
+
+    // The compact tree links nodes by index; compare its footprint per item
+    CompactAVLTree<int, int> compact;
+    for (int i = 0; i < 1000; i++)
+        compact.insert(std::make_pair(i, i * i));
+    for (int i = 0; i < 1000; i += 3)
+        compact.remove(i);
+    compact.insert(std::make_pair(3, 33));
+    compact.reserve(1000);
+    cout << "\nCompact tree: " << compact.size() << " keys, balanced: " << compact.isBalanced()
+         << ", value of 3: " << compact[3] << ", value of 4: " << compact[4]
+         << ", bytes per node: " << compact.memoryUsage() / 1000 << " (AVLNode: " << sizeof(AVLNode<int, int>) << ")" << endl;
+
+    // Without parent pointers, iterators walk a stack of ancestors both ways
+    ParentlessAVLTree<std::string, int> lean;
+    const char *fruits[] = {"pear", "fig", "kiwi", "apple", "plum", "lime", "date"};
+    for (int i = 0; i < 7; i++)
+        lean.insert(std::make_pair(std::string(fruits[i]), i));
+    lean.remove("kiwi");
+    lean["fig"] = 10;
+    cout << "\nParentless tree: " << lean.size() << " keys, balanced: " << lean.isBalanced() << ", backwards:";
+    for (ParentlessAVLTree<std::string, int>::iterator it = lean.end(); it != lean.begin();)
+    {
+        --it;
+        cout << " " << it->first << "=" << it->second;
+    }
+    cout << endl;
+
     return 0;
 }
@@ -5,21 +5,70 @@
 #include <exception>
 #include <cstdlib>
 #include <utility>
+#include <tuple>
 #include <stack>
+#include <new>
+#include <type_traits>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include "node_pool.h"
+#include "frozen_bst.h"
+
+/**
+ * In-order neighbour links for threaded nodes. A tree whose nodes are
+ * threaded keeps next/prev current through every insert and remove, so an
+ * iterator step is a single pointer load. The unthreaded specialization
+ * below is empty and adds nothing to a node.
+ */
+template <typename NodeType, bool Threaded>
+class NodeThreads
+{
+public:
+    static const bool threaded = true;
+
+    NodeThreads() : next_(NULL), prev_(NULL) {}
+
+    NodeType *getNext() const { return next_; }
+    NodeType *getPrev() const { return prev_; }
+    void setNext(NodeType *next) { next_ = next; }
+    void setPrev(NodeType *prev) { prev_ = prev; }
+
+protected:
+    NodeType *next_;
+    NodeType *prev_;
+};
+
+template <typename NodeType>
+class NodeThreads<NodeType, false>
+{
+public:
+    static const bool threaded = false;
+};
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * Kinds of search trees that need extra per-node data, such as
+ * Red Black trees, Splay trees, and AVL trees, derive their node
+ * from Node<Key, Value, Derived> (CRTP). The links are then stored
+ * and returned as Derived pointers, so the getters need neither
+ * virtual dispatch nor a vtable pointer in every node.
+ * Threaded nodes also carry in-order neighbour links (see NodeThreads).
  */
-template <typename Key, typename Value>
-class Node
+template <typename Key, typename Value, typename Derived = void, bool Threaded = false>
+class Node : public NodeThreads<typename std::conditional<std::is_void<Derived>::value,
+                                                          Node<Key, Value, Derived, Threaded>, Derived>::type,
+                                Threaded>
 {
 public:
-    Node(const Key &key, const Value &value, Node<Key, Value> *parent);
-    virtual ~Node();
+    // The most derived node type, which parent/left/right point to
+    typedef typename std::conditional<std::is_void<Derived>::value,
+                                      Node<Key, Value, Derived, Threaded>, Derived>::type NodeType;
+
+    Node(const Key &key, const Value &value, NodeType *parent);
+    // Builds the item in place from a tuple of key and a tuple of value arguments
+    template <typename KeyArgs, typename ValueArgs>
+    Node(NodeType *parent, std::piecewise_construct_t, KeyArgs keyArgs, ValueArgs valueArgs);
 
     const std::pair<const Key, Value> &getItem() const;
     std::pair<const Key, Value> &getItem();
@@ -27,20 +76,29 @@ public:
     const Value &getValue() const;
     Value &getValue();
 
-    virtual Node<Key, Value> *getParent() const;
-    virtual Node<Key, Value> *getLeft() const;
-    virtual Node<Key, Value> *getRight() const;
+    NodeType *getParent() const;
+    NodeType *getLeft() const;
+    NodeType *getRight() const;
 
-    void setParent(Node<Key, Value> *parent);
-    void setLeft(Node<Key, Value> *left);
-    void setRight(Node<Key, Value> *right);
+    void setParent(NodeType *parent);
+    void setLeft(NodeType *left);
+    void setRight(NodeType *right);
     void setValue(const Value &value);
+    void setValue(Value &&value);
+
+    // Number of nodes in the subtree rooted here, including this one
+    std::size_t getSubtreeSize() const;
+    void setSubtreeSize(std::size_t size);
+
+    // Called by bulk builds with the heights of the freshly linked subtrees
+    void setChildHeights(int leftHeight, int rightHeight);
 
 protected:
     std::pair<const Key, Value> item_;
-    Node<Key, Value> *parent_;
-    Node<Key, Value> *left_;
-    Node<Key, Value> *right_;
+    NodeType *parent_;
+    NodeType *left_;
+    NodeType *right_;
+    std::size_t size_;
 };
 
 /*
@@ -52,29 +110,35 @@ protected:
 /**
  * Explicit constructor for a node.
  */
-template <typename Key, typename Value>
-Node<Key, Value>::Node(const Key &key, const Value &value, Node<Key, Value> *parent) : item_(key, value),
+template <typename Key, typename Value, typename Derived, bool Threaded>
+Node<Key, Value, Derived, Threaded>::Node(const Key &key, const Value &value, NodeType *parent) : item_(key, value),
                                                                                        parent_(parent),
                                                                                        left_(NULL),
-                                                                                       right_(NULL)
+                                                                                       right_(NULL),
+                                                                                       size_(1)
 {
 }
 
 /**
- * Destructor, which does not need to do anything since the pointers inside of a node
- * are only used as references to existing nodes. The nodes pointed to by parent/left/right
- * are freed by the BinarySearchTree.
+ * An in-place constructor: the key and value are built directly inside the
+ * node from the forwarded tuples, so nothing is copied or moved twice.
  */
-template <typename Key, typename Value>
-Node<Key, Value>::~Node()
+template <typename Key, typename Value, typename Derived, bool Threaded>
+template <typename KeyArgs, typename ValueArgs>
+Node<Key, Value, Derived, Threaded>::Node(NodeType *parent, std::piecewise_construct_t, KeyArgs keyArgs, ValueArgs valueArgs)
+    : item_(std::piecewise_construct, std::move(keyArgs), std::move(valueArgs)),
+      parent_(parent),
+      left_(NULL),
+      right_(NULL),
+      size_(1)
 {
 }
 
 /**
  * A const getter for the item.
  */
-template <typename Key, typename Value>
-const std::pair<const Key, Value> &Node<Key, Value>::getItem() const
+template <typename Key, typename Value, typename Derived, bool Threaded>
+const std::pair<const Key, Value> &Node<Key, Value, Derived, Threaded>::getItem() const
 {
     return item_;
 }
@@ -82,8 +146,8 @@ const std::pair<const Key, Value> &Node<Key, Value>::getItem() const
 /**
  * A non-const getter for the item.
  */
-template <typename Key, typename Value>
-std::pair<const Key, Value> &Node<Key, Value>::getItem()
+template <typename Key, typename Value, typename Derived, bool Threaded>
+std::pair<const Key, Value> &Node<Key, Value, Derived, Threaded>::getItem()
 {
     return item_;
 }
@@ -91,8 +155,8 @@ std::pair<const Key, Value> &Node<Key, Value>::getItem()
 /**
  * A const getter for the key.
  */
-template <typename Key, typename Value>
-const Key &Node<Key, Value>::getKey() const
+template <typename Key, typename Value, typename Derived, bool Threaded>
+const Key &Node<Key, Value, Derived, Threaded>::getKey() const
 {
     return item_.first;
 }
@@ -100,8 +164,8 @@ const Key &Node<Key, Value>::getKey() const
 /**
  * A const getter for the value.
  */
-template <typename Key, typename Value>
-const Value &Node<Key, Value>::getValue() const
+template <typename Key, typename Value, typename Derived, bool Threaded>
+const Value &Node<Key, Value, Derived, Threaded>::getValue() const
 {
     return item_.second;
 }
@@ -109,35 +173,35 @@ const Value &Node<Key, Value>::getValue() const
 /**
  * A non-const getter for the value.
  */
-template <typename Key, typename Value>
-Value &Node<Key, Value>::getValue()
+template <typename Key, typename Value, typename Derived, bool Threaded>
+Value &Node<Key, Value, Derived, Threaded>::getValue()
 {
     return item_.second;
 }
 
 /**
- * An implementation of the virtual function for retreiving the parent.
+ * A getter for the parent.
  */
-template <typename Key, typename Value>
-Node<Key, Value> *Node<Key, Value>::getParent() const
+template <typename Key, typename Value, typename Derived, bool Threaded>
+typename Node<Key, Value, Derived, Threaded>::NodeType *Node<Key, Value, Derived, Threaded>::getParent() const
 {
     return parent_;
 }
 
 /**
- * An implementation of the virtual function for retreiving the left child.
+ * A getter for the left child.
  */
-template <typename Key, typename Value>
-Node<Key, Value> *Node<Key, Value>::getLeft() const
+template <typename Key, typename Value, typename Derived, bool Threaded>
+typename Node<Key, Value, Derived, Threaded>::NodeType *Node<Key, Value, Derived, Threaded>::getLeft() const
 {
     return left_;
 }
 
 /**
- * An implementation of the virtual function for retreiving the right child.
+ * A getter for the right child.
  */
-template <typename Key, typename Value>
-Node<Key, Value> *Node<Key, Value>::getRight() const
+template <typename Key, typename Value, typename Derived, bool Threaded>
+typename Node<Key, Value, Derived, Threaded>::NodeType *Node<Key, Value, Derived, Threaded>::getRight() const
 {
     return right_;
 }
@@ -145,8 +209,8 @@ Node<Key, Value> *Node<Key, Value>::getRight() const
 /**
  * A setter for setting the parent of a node.
  */
-template <typename Key, typename Value>
-void Node<Key, Value>::setParent(Node<Key, Value> *parent)
+template <typename Key, typename Value, typename Derived, bool Threaded>
+void Node<Key, Value, Derived, Threaded>::setParent(NodeType *parent)
 {
     parent_ = parent;
 }
@@ -154,8 +218,8 @@ void Node<Key, Value>::setParent(Node<Key, Value> *parent)
 /**
  * A setter for setting the left child of a node.
  */
-template <typename Key, typename Value>
-void Node<Key, Value>::setLeft(Node<Key, Value> *left)
+template <typename Key, typename Value, typename Derived, bool Threaded>
+void Node<Key, Value, Derived, Threaded>::setLeft(NodeType *left)
 {
     left_ = left;
 }
@@ -163,8 +227,8 @@ void Node<Key, Value>::setLeft(Node<Key, Value> *left)
 /**
  * A setter for setting the right child of a node.
  */
-template <typename Key, typename Value>
-void Node<Key, Value>::setRight(Node<Key, Value> *right)
+template <typename Key, typename Value, typename Derived, bool Threaded>
+void Node<Key, Value, Derived, Threaded>::setRight(NodeType *right)
 {
     right_ = right;
 }
@@ -172,41 +236,106 @@ void Node<Key, Value>::setRight(Node<Key, Value> *right)
 /**
  * A setter for the value of a node.
  */
-template <typename Key, typename Value>
-void Node<Key, Value>::setValue(const Value &value)
+template <typename Key, typename Value, typename Derived, bool Threaded>
+void Node<Key, Value, Derived, Threaded>::setValue(const Value &value)
 {
     item_.second = value;
 }
 
+/**
+ * A setter that moves the new value into the node.
+ */
+template <typename Key, typename Value, typename Derived, bool Threaded>
+void Node<Key, Value, Derived, Threaded>::setValue(Value &&value)
+{
+    item_.second = std::move(value);
+}
+
+/**
+ * A getter for the number of nodes in this node's subtree.
+ */
+template <typename Key, typename Value, typename Derived, bool Threaded>
+std::size_t Node<Key, Value, Derived, Threaded>::getSubtreeSize() const
+{
+    return size_;
+}
+
+/**
+ * A setter for the number of nodes in this node's subtree.
+ */
+template <typename Key, typename Value, typename Derived, bool Threaded>
+void Node<Key, Value, Derived, Threaded>::setSubtreeSize(std::size_t size)
+{
+    size_ = size;
+}
+
+/**
+ * Plain nodes keep no shape data, so there is nothing to record.
+ * Node types that do (e.g. AVLNode) hide this with their own version.
+ */
+template <typename Key, typename Value, typename Derived, bool Threaded>
+void Node<Key, Value, Derived, Threaded>::setChildHeights(int leftHeight, int rightHeight)
+{
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
   ---------------------------------------
 */
 
+/**
+ * Shape metrics of a tree, as reported by BinarySearchTree::shape().
+ */
+struct TreeShape
+{
+    int height;            // number of nodes on the longest root-to-leaf path
+    std::size_t nodeCount; // number of nodes in the tree
+    int maxSkew;           // largest |height(left) - height(right)| over all nodes
+};
+
 /**
  * A templated unbalanced binary search tree.
+ * NodeT is the node type the tree links together; trees that keep extra
+ * per-node data (e.g. AVLTree) pass their own Node subclass here so that
+ * all traversals resolve at compile time. Nodes are obtained from Alloc
+ * (see node_pool.h), whose value_type must be large enough to hold a NodeT.
+ * Keys are ordered by Compare, a strict weak ordering (i.e. "less than");
+ * a transparent Compare (e.g. std::less<>) also allows lookups by any type
+ * it can compare against Key, without building a temporary Key.
  */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Compare = std::less<Key>,
+          typename NodeT = Node<Key, Value>, typename Alloc = HeapAllocator<NodeT> >
 class BinarySearchTree
 {
 public:
+    typedef Compare key_compare;
+
     BinarySearchTree();
+    explicit BinarySearchTree(const Compare &comp);
+    template <typename InputIt>
+    BinarySearchTree(InputIt first, InputIt last, const Compare &comp = Compare());
     virtual ~BinarySearchTree();
     virtual void insert(const std::pair<const Key, Value> &keyValuePair);
+    template <typename P, typename = typename std::enable_if<
+                              std::is_constructible<std::pair<const Key, Value>, P &&>::value>::type>
+    void insert(P &&keyValuePair);
     virtual void remove(const Key &key);
     void clear();
-    void clearSubtree(Node<Key, Value> *n);
-    Node<Key, Value> *insertHelper(Node<Key, Value> *n, const std::pair<const Key, Value> &keyValuePair);
+    template <typename InputIt>
+    void assign(InputIt first, InputIt last);
+    template <typename InputIt>
+    void insert_sorted_batch(InputIt first, InputIt last);
+    void clearSubtree(NodeT *n);
+    NodeT *insertHelper(NodeT *n, const std::pair<const Key, Value> &keyValuePair);
     bool isBalanced() const;
+    TreeShape shape() const;
     void print() const;
     bool empty() const;
+    std::size_t size() const;
 
-    template <typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> &tree);
-
-private:
-    bool checkBalance(Node<Key, Value> *n) const;
+    template <typename PPKey, typename PPValue, typename PPCompare, typename PPNodeT, typename PPAlloc>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPCompare, PPNodeT, PPAlloc> &tree);
 
 public:
     /**
@@ -215,6 +344,12 @@ public:
     class iterator
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value> *pointer;
+        typedef std::pair<const Key, Value> &reference;
+
         iterator();
 
         std::pair<const Key, Value> &operator*() const;
@@ -224,38 +359,154 @@ public:
         bool operator!=(const iterator &rhs) const;
 
         iterator &operator++();
+        iterator operator++(int);
+        iterator &operator--();
+        iterator operator--(int);
+        iterator &operator+=(std::size_t k);
+
+    protected:
+        friend class BinarySearchTree<Key, Value, Compare, NodeT, Alloc>;
+        iterator(NodeT *ptr, const BinarySearchTree<Key, Value, Compare, NodeT, Alloc> *tree);
+        NodeT *current_;
+        const BinarySearchTree<Key, Value, Compare, NodeT, Alloc> *tree_; // lets --end() find the last item
+    };
+
+    /**
+     * A read-only counterpart of iterator. Any iterator converts to one.
+     */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value> *pointer;
+        typedef const std::pair<const Key, Value> &reference;
+
+        const_iterator();
+        const_iterator(const iterator &it);
+
+        const std::pair<const Key, Value> &operator*() const;
+        const std::pair<const Key, Value> *operator->() const;
+
+        // Non-members, so that an iterator converts on either side
+        friend bool operator==(const const_iterator &lhs, const const_iterator &rhs)
+        {
+            return lhs.current_ == rhs.current_;
+        }
+        friend bool operator!=(const const_iterator &lhs, const const_iterator &rhs)
+        {
+            return lhs.current_ != rhs.current_;
+        }
+
+        const_iterator &operator++();
+        const_iterator operator++(int);
+        const_iterator &operator--();
+        const_iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key, Value> *ptr);
-        Node<Key, Value> *current_;
+        friend class BinarySearchTree<Key, Value, Compare, NodeT, Alloc>;
+        const NodeT *current_;
+        const BinarySearchTree<Key, Value, Compare, NodeT, Alloc> *tree_;
     };
 
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
 public:
     iterator begin() const;
     iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
     iterator find(const Key &key) const;
+    template <typename K, typename C = Compare, typename = typename C::is_transparent>
+    iterator find(const K &key) const;
+    template <typename KeyRange, typename OutIt>
+    void find_batch(const KeyRange &keys, OutIt out) const;
     Value &operator[](const Key &key);
     Value const &operator[](const Key &key) const;
+    iterator select(std::size_t k) const;
+    std::size_t rank(const Key &key) const;
+
+    // Range queries, each a single O(log n) descent
+    iterator lower_bound(const Key &key) const;
+    iterator upper_bound(const Key &key) const;
+    std::pair<iterator, iterator> equal_range(const Key &key) const;
+    iterator floor(const Key &key) const;
+    iterator ceiling(const Key &key) const;
+    std::size_t count_range(const Key &lo, const Key &hi) const;
+
+    // A read-only copy in a cache-oblivious layout, for lookup-only phases
+    FrozenTree<Key, Value, Compare> freeze() const;
+
+    // In-place insertion; a node is only allocated once the key is known to be absent
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args &&...args);
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const Key &key, Args &&...args);
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(Key &&key, Args &&...args);
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(const Key &key, M &&obj);
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(Key &&key, M &&obj);
+
+    // Hinted insertion: O(1) comparisons when the key belongs right before hint
+    iterator insert(const_iterator hint, const std::pair<const Key, Value> &keyValuePair);
+    template <typename... Args>
+    iterator emplace_hint(const_iterator hint, Args &&...args);
 
 protected:
     // Mandatory helper functions
-    Node<Key, Value> *internalFind(const Key &k) const;
-    Node<Key, Value> *getSmallestNode() const;
-    static Node<Key, Value> *pred(Node<Key, Value> *current);
+    NodeT *internalFind(const Key &k) const;
+    NodeT *getSmallestNode() const;
+    NodeT *getLargestNode() const;
+    static NodeT *pred(NodeT *current);
+    static NodeT *successor(NodeT *current);
+    static NodeT *predecessor(NodeT *current);
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
 
     // Provided helper functions
-    virtual void printRoot(Node<Key, Value> *r) const;
-    virtual void nodeSwap(Node<Key, Value> *n1, Node<Key, Value> *n2);
+    virtual void printRoot(NodeT *r) const;
+    virtual void nodeSwap(NodeT *n1, NodeT *n2);
 
     // Add helper functions here
-    Node<Key, Value> *getNode(const Key &k, Node<Key, Value> *n) const;
-    int getHeight(Node<Key, Value> *n) const;
+    template <typename K>
+    NodeT *getNode(const K &k, NodeT *n) const;
+    template <typename K>
+    NodeT *lowerBoundNode(const K &k, NodeT *n) const;
+    NodeT *upperBoundNode(const Key &k) const;
+    NodeT *floorNode(const Key &k) const;
+    NodeT *findInsertPosition(const Key &key, NodeT *&parent, bool &setLeftChild) const;
+    NodeT *findHintedPosition(NodeT *hint, const Key &key, NodeT *&parent, bool &setLeftChild) const;
+    int getHeight(NodeT *n) const;
+    template <typename KeyArg, typename... ValueArgs>
+    NodeT *createNode(NodeT *parent, KeyArg &&key, ValueArgs &&...valueArgs);
+    void destroyNode(NodeT *n);
+    template <typename KeyArg, typename... ValueArgs>
+    std::pair<NodeT *, bool> emplaceUnique(NodeT *hint, KeyArg &&key, ValueArgs &&...valueArgs);
+    void linkNewNode(NodeT *n, NodeT *parent, bool setLeftChild);
+    virtual void insertFix(NodeT *n);
+    static std::size_t subtreeSize(const NodeT *n);
+    static NodeT *selectNode(NodeT *n, std::size_t k);
+    static void adjustSubtreeSizes(NodeT *n, int delta);
+    template <typename It>
+    NodeT *buildSorted(It &it, std::size_t n, NodeT *parent, int &height, NodeT *&last);
+    void linkThreads(NodeT *n);
+    void unlinkThreads(NodeT *n);
+    static void prefetchNode(const NodeT *n);
 
 protected:
-    Node<Key, Value> *root_;
+    NodeT *root_;
+    NodeT *first_; // smallest node; only kept for threaded nodes
+    NodeT *last_;  // largest node, for O(1) appends and --end()
+    Alloc alloc_;
+    Compare comp_;
     // You should not need other data members
 };
 
@@ -268,25 +519,25 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
  * Explicit constructor that initializes an iterator with a given node pointer.
  */
-template <class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key, Value> *ptr) : current_(ptr)
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::iterator(NodeT *ptr, const BinarySearchTree<Key, Value, Compare, NodeT, Alloc> *tree) : current_(ptr), tree_(tree)
 {
 }
 
 /**
  * A default constructor that initializes the iterator to NULL.
  */
-template <class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() : current_(NULL)
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::iterator() : current_(NULL), tree_(NULL)
 {
 }
 
 /**
  * Provides access to the item.
  */
-template <class Key, class Value>
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
 std::pair<const Key, Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -294,9 +545,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
  * Provides access to the address of the item.
  */
-template <class Key, class Value>
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
 std::pair<const Key, Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -305,9 +556,9 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
  * Checks if 'this' iterator's internals have the same value
  * as 'rhs'
  */
-template <class Key, class Value>
-bool BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator &rhs) const
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+bool BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator &rhs) const
 {
     return this->current_ == rhs.current_;
 }
@@ -316,9 +567,9 @@ bool BinarySearchTree<Key, Value>::iterator::operator==(
  * Checks if 'this' iterator's internals have a different value
  * as 'rhs'
  */
-template <class Key, class Value>
-bool BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator &rhs) const
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+bool BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator &rhs) const
 {
     return this->current_ != rhs.current_;
 }
@@ -326,29 +577,70 @@ bool BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
  * Advances the iterator's location using an in-order sequencing
  */
-template <class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator &
-BinarySearchTree<Key, Value>::iterator::operator++()
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator &
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::operator++()
 {
     // Base case: Return NULL iterator if current node is empty
+    if (current_ != NULL)
+        current_ = successor(current_);
+    return *this;
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/**
+ * Moves the iterator back one place in order. Stepping back from the
+ * end iterator lands on the largest item.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator &
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::operator--()
+{
     if (current_ == NULL)
+        current_ = tree_->getLargestNode();
+    else
+        current_ = predecessor(current_);
+    return *this;
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/**
+ * Advances the iterator k places in O(log n): climbs to the root while
+ * working out the current rank, then selects rank + k from there.
+ * Moving past the last item yields the end iterator.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator &
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator::operator+=(std::size_t k)
+{
+    if (current_ == NULL || k == 0)
         return *this;
 
-    // @condition If right tree exists, find successor
-    if (current_->getRight() != NULL)
+    NodeT *n = current_;
+    std::size_t r = subtreeSize(n->getLeft());
+    while (n->getParent() != NULL)
     {
-        current_ = current_->getRight();
-        while (current_->getLeft() != NULL)
-        {
-            current_ = current_->getLeft();
-        }
-        return *this;
+        if (n->getParent()->getRight() == n)
+            r += subtreeSize(n->getParent()->getLeft()) + 1;
+        n = n->getParent();
     }
-
-    // Right subtree cases
-    while (current_->getParent() && current_->getParent()->getRight() == current_)
-        current_ = current_->getParent(); // If right child, go back one node
-    current_ = current_->getParent();
+    current_ = selectNode(n, r + k);
     return *this;
 }
 
@@ -358,6 +650,86 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+--------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+--------------------------------------------------------------------
+*/
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator::const_iterator() : current_(NULL), tree_(NULL)
+{
+}
+
+/**
+ * Converting constructor, so any iterator can be used where a const_iterator is expected.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator::const_iterator(const iterator &it) : current_(it.current_), tree_(it.tree_)
+{
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+const std::pair<const Key, Value> &
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator::operator*() const
+{
+    return current_->getItem();
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+const std::pair<const Key, Value> *
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator::operator->() const
+{
+    return &(current_->getItem());
+}
+
+/**
+ * Same traversal as iterator; the tree's nodes are only ever read through it.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator &
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator::operator++()
+{
+    if (current_ != NULL)
+        current_ = successor(const_cast<NodeT *>(current_));
+    return *this;
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator &
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator::operator--()
+{
+    if (current_ == NULL)
+        current_ = tree_->getLargestNode();
+    else
+        current_ = predecessor(const_cast<NodeT *>(current_));
+    return *this;
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+------------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+------------------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -367,29 +739,64 @@ Begin implementations for the BinarySearchTree class.
 /**
  * Default constructor for a BinarySearchTree, which sets the root to NULL.
  */
-template <class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree()
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::BinarySearchTree() : comp_()
 {
+    static_assert(sizeof(NodeT) <= sizeof(typename Alloc::value_type),
+                  "Alloc must hand out storage large enough for a node");
     root_ = NULL;
+    first_ = NULL;
+    last_ = NULL;
+}
+
+/**
+ * Constructor for a BinarySearchTree ordered by the given comparator.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::BinarySearchTree(const Compare &comp) : root_(NULL), first_(NULL), last_(NULL), comp_(comp)
+{
+    static_assert(sizeof(NodeT) <= sizeof(typename Alloc::value_type),
+                  "Alloc must hand out storage large enough for a node");
 }
 
-template <typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::~BinarySearchTree()
 {
     this->clear();
 }
 
+/**
+ * Constructor that bulk-loads the items in [first, last); see assign().
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename InputIt>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::BinarySearchTree(InputIt first, InputIt last, const Compare &comp) : root_(NULL), first_(NULL), last_(NULL), comp_(comp)
+{
+    static_assert(sizeof(NodeT) <= sizeof(typename Alloc::value_type),
+                  "Alloc must hand out storage large enough for a node");
+    assign(first, last);
+}
+
 /**
  * Returns true if tree is empty
  */
-template <class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+bool BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::empty() const
 {
     return root_ == NULL;
 }
 
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+ * Returns the number of items in the tree
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+std::size_t BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::size() const
+{
+    return subtreeSize(root_);
+}
+
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
@@ -398,134 +805,440 @@ void BinarySearchTree<Key, Value>::print() const
 /**
  * Returns an iterator to the "smallest" item in the tree
  */
-template <class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator begin(getSmallestNode(), this);
     return begin;
 }
 
 /**
  * Returns an iterator whose value means INVALID
  */
-template <class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::end() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator end(NULL, this);
     return end;
 }
 
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::cbegin() const
+{
+    return begin();
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::cend() const
+{
+    return end();
+}
+
+/**
+ * Returns a reverse iterator to the "largest" item in the tree
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::reverse_iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::rbegin() const
+{
+    return reverse_iterator(end());
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::reverse_iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::rend() const
+{
+    return reverse_iterator(begin());
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::crbegin() const
+{
+    return const_reverse_iterator(cend());
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::crend() const
+{
+    return const_reverse_iterator(cbegin());
+}
+
 /**
  * Returns an iterator to the item with the given key, k
  * or the end iterator if k does not exist in the tree
  */
-template <class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key &k) const
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::find(const Key &k) const
 {
-    Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    NodeT *curr = internalFind(k);
+    BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator it(curr, this);
     return it;
 }
 
+/**
+ * Heterogeneous find, only available with a transparent Compare.
+ * Looks k up without converting it to a Key first.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename K, typename C, typename>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::find(const K &k) const
+{
+    return iterator(getNode(k, root_), this);
+}
+
+/**
+ * Looks up every key in keys and writes one iterator per key (the end
+ * iterator if it is missing) to out, in order.
+ * Lookups run FIND_BATCH_WIDTH at a time as a small state machine: every
+ * round moves each unfinished lookup down one level, as in lowerBoundNode,
+ * and prefetches the node it will read next. The cache misses of a group
+ * overlap instead of each find() waiting out one miss per level in turn.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename KeyRange, typename OutIt>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::find_batch(const KeyRange &keys, OutIt out) const
+{
+    typedef decltype(std::begin(keys)) KeyIt;
+    const std::size_t FIND_BATCH_WIDTH = 16;
+    KeyIt key[FIND_BATCH_WIDTH];
+    NodeT *next[FIND_BATCH_WIDTH];
+    NodeT *candidate[FIND_BATCH_WIDTH];
+
+    KeyIt it = std::begin(keys), last = std::end(keys);
+    while (it != last)
+    {
+        std::size_t width = 0;
+        for (; width < FIND_BATCH_WIDTH && it != last; ++it, ++width)
+        {
+            key[width] = it;
+            next[width] = root_;
+            candidate[width] = NULL;
+        }
+
+        // @summary One level per lookup per round, until every lookup has fallen off the tree
+        bool active = true;
+        while (active)
+        {
+            active = false;
+            for (std::size_t j = 0; j < width; j++)
+            {
+                NodeT *n = next[j];
+                if (n == NULL)
+                    continue;
+                if (comp_(n->getKey(), *key[j]))
+                    n = n->getRight();
+                else
+                {
+                    candidate[j] = n;
+                    n = n->getLeft();
+                }
+                prefetchNode(n);
+                next[j] = n;
+                active = active || n != NULL;
+            }
+        }
+
+        for (std::size_t j = 0; j < width; j++)
+        {
+            NodeT *found = candidate[j];
+            if (found != NULL && comp_(*key[j], found->getKey()))
+                found = NULL;
+            *out++ = iterator(found, this);
+        }
+    }
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
  */
-template <class Key, class Value>
-Value &BinarySearchTree<Key, Value>::operator[](const Key &key)
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+Value &BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::operator[](const Key &key)
 {
-    Node<Key, Value> *curr = internalFind(key);
+    NodeT *curr = internalFind(key);
     if (curr == NULL)
         throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
-template <class Key, class Value>
-Value const &BinarySearchTree<Key, Value>::operator[](const Key &key) const
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+Value const &BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::operator[](const Key &key) const
 {
-    Node<Key, Value> *curr = internalFind(key);
+    NodeT *curr = internalFind(key);
     if (curr == NULL)
         throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
 
 /**
- * An insert method to insert into a Binary Search Tree.
- * The tree will not remain balanced when inserting.
- * Recall: If key is already in the tree, you should
- * overwrite the current value with the updated value.
+ * Returns an iterator to the k-th smallest item (counting from 0),
+ * or the end iterator if the tree holds k items or fewer
  */
-template <class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::select(std::size_t k) const
 {
+    return iterator(selectNode(root_, k), this);
+}
 
-    // @condition Create new root node if it doesn't exist
-    if (root_ == NULL)
+/**
+ * Returns the number of keys in the tree that are less than key
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+std::size_t BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::rank(const Key &key) const
+{
+    std::size_t r = 0;
+    NodeT *n = root_;
+    while (n != NULL)
     {
-        root_ = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, NULL);
-        return;
+        if (comp_(n->getKey(), key))
+        {
+            r += subtreeSize(n->getLeft()) + 1;
+            n = n->getRight();
+        }
+        else
+            n = n->getLeft();
     }
+    return r;
+}
 
-    // @summary Search for appropiate key location
-    Node<Key, Value> *p = NULL;
-    Node<Key, Value> *newNode = root_;
-    bool setLeftChild = false;
+/**
+ * Returns an iterator to the first item whose key is not less than key,
+ * or the end iterator if there is none
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::lower_bound(const Key &key) const
+{
+    return iterator(lowerBoundNode(key, root_), this);
+}
 
-    while (newNode != NULL)
-    {
-        p = newNode; // will become the parent
+/**
+ * Returns an iterator to the first item whose key is greater than key,
+ * or the end iterator if there is none
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::upper_bound(const Key &key) const
+{
+    return iterator(upperBoundNode(key), this);
+}
 
-        // @condition If key is smaller, traverse left subtree
-        if (keyValuePair.first < newNode->getKey())
-        {
-            newNode = newNode->getLeft();
-            setLeftChild = true;
-        }
-        else if (keyValuePair.first > newNode->getKey())
-        {
+/**
+ * Returns the range of items whose key is equal to key (at most one item)
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+std::pair<typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator,
+          typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::equal_range(const Key &key) const
+{
+    NodeT *lower = lowerBoundNode(key, root_);
+    if (lower == NULL || comp_(key, lower->getKey()))
+        return std::make_pair(iterator(lower, this), iterator(lower, this));
+    iterator upper(lower, this);
+    ++upper;
+    return std::make_pair(iterator(lower, this), upper);
+}
 
-            newNode = newNode->getRight();
-            setLeftChild = false;
+/**
+ * Returns an iterator to the item with the largest key not greater than key,
+ * or the end iterator if there is none
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::floor(const Key &key) const
+{
+    return iterator(floorNode(key), this);
+}
 
-        } // @condition If key is the same, update value
-        else if (keyValuePair.first == newNode->getKey())
-        {
-            newNode->setValue(keyValuePair.second);
-            return;
-        }
-    }
+/**
+ * Returns an iterator to the item with the smallest key not less than key,
+ * or the end iterator if there is none
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::ceiling(const Key &key) const
+{
+    return lower_bound(key);
+}
 
-    newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, p);
+/**
+ * Returns the number of keys in [lo, hi) without visiting them,
+ * as the difference of two O(log n) rank queries
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+std::size_t BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::count_range(const Key &lo, const Key &hi) const
+{
+    if (!comp_(lo, hi))
+        return 0;
+    return rank(hi) - rank(lo);
+}
 
-    // @condition Determine direction of child and set new parent
-    if (!setLeftChild)
-    {
-        p->setRight(newNode);
-    }
-    else
-    {
-        p->setLeft(newNode);
-    }
+/**
+ * Compiles the tree into a FrozenTree with the same items, in O(n).
+ * Later changes to this tree do not show up in it.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+FrozenTree<Key, Value, Compare> BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::freeze() const
+{
+    return FrozenTree<Key, Value, Compare>(begin(), end(), comp_);
 }
 
 /**
- * A remove method to remove a specific key from a Binary Search Tree.
- * Recall: The writeup specifies that if a node has 2 children you
- * should swap with the pred and then remove.
+ * An insert method to insert into a Binary Search Tree.
+ * The tree will not remain balanced when inserting.
+ * Recall: If key is already in the tree, you should
+ * overwrite the current value with the updated value.
  */
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key &key)
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
-    Node<Key, Value> *n = internalFind(key);
-    if (n == NULL)
-        return;
-    Node<Key, Value> *p = n->getParent();
-    if (n->getLeft() == NULL && n->getRight() == NULL)
-    {
-        // @condition If leaf node, remove
-        if (p == NULL)
+    std::pair<NodeT *, bool> result = emplaceUnique(NULL, keyValuePair.first, keyValuePair.second);
+
+    // @condition If key is the same, update value
+    if (!result.second)
+        result.first->setValue(keyValuePair.second);
+}
+
+/**
+ * Inserts a pair of any type convertible to the tree's items, e.g. an
+ * rvalue std::pair<Key, Value>, moving its key and value into the new node
+ * instead of copying them. Like insert above, an existing value is overwritten.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename P, typename>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::insert(P &&keyValuePair)
+{
+    std::pair<NodeT *, bool> result = emplaceUnique(NULL, std::get<0>(std::forward<P>(keyValuePair)),
+                                                    std::get<1>(std::forward<P>(keyValuePair)));
+
+    // @condition The value was left untouched when the key was found, so it can still be moved
+    if (!result.second)
+        result.first->setValue(std::get<1>(std::forward<P>(keyValuePair)));
+}
+
+/**
+ * Inserts an item built from args (as for std::pair<const Key, Value>) unless
+ * its key is already present, in which case the tree is left unchanged.
+ * The item is built on the stack first, since its key is needed for the
+ * search, and then moved into the node only if one is needed.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::emplace(Args &&...args)
+{
+    std::pair<Key, Value> item(std::forward<Args>(args)...);
+    std::pair<NodeT *, bool> result = emplaceUnique(NULL, std::move(item.first), std::move(item.second));
+    return std::make_pair(iterator(result.first, this), result.second);
+}
+
+/**
+ * Inserts key with a value built in place from args, unless key is already
+ * present. Then neither key nor args are touched, and nothing is allocated.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::try_emplace(const Key &key, Args &&...args)
+{
+    std::pair<NodeT *, bool> result = emplaceUnique(NULL, key, std::forward<Args>(args)...);
+    return std::make_pair(iterator(result.first, this), result.second);
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename... Args>
+std::pair<typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::try_emplace(Key &&key, Args &&...args)
+{
+    std::pair<NodeT *, bool> result = emplaceUnique(NULL, std::move(key), std::forward<Args>(args)...);
+    return std::make_pair(iterator(result.first, this), result.second);
+}
+
+/**
+ * Assigns obj to key's value if key is present, otherwise inserts it.
+ * The second member of the result is true if a new node was inserted.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::insert_or_assign(const Key &key, M &&obj)
+{
+    std::pair<NodeT *, bool> result = emplaceUnique(NULL, key, std::forward<M>(obj));
+    if (!result.second)
+        result.first->getValue() = std::forward<M>(obj);
+    return std::make_pair(iterator(result.first, this), result.second);
+}
+
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename M>
+std::pair<typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator, bool>
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::insert_or_assign(Key &&key, M &&obj)
+{
+    std::pair<NodeT *, bool> result = emplaceUnique(NULL, std::move(key), std::forward<M>(obj));
+    if (!result.second)
+        result.first->getValue() = std::forward<M>(obj);
+    return std::make_pair(iterator(result.first, this), result.second);
+}
+
+/**
+ * Inserts keyValuePair, overwriting the value if the key is already present,
+ * like insert above. If the key belongs immediately before hint (or right
+ * after it), it is linked in next to hint after O(1) comparisons instead of
+ * a descent from the root, so feeding in nearly sorted keys with the
+ * previous result (or end()) as the hint avoids the search entirely.
+ * A wrong hint only costs the normal search. Returns the key's position.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::insert(const_iterator hint, const std::pair<const Key, Value> &keyValuePair)
+{
+    std::pair<NodeT *, bool> result = emplaceUnique(const_cast<NodeT *>(hint.current_),
+                                                    keyValuePair.first, keyValuePair.second);
+    if (!result.second)
+        result.first->setValue(keyValuePair.second);
+    return iterator(result.first, this);
+}
+
+/**
+ * Hinted emplace: as emplace, with the search starting from hint as for
+ * the hinted insert. Returns the position of the new or existing key.
+ */
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+template <typename... Args>
+typename BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::iterator
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::emplace_hint(const_iterator hint, Args &&...args)
+{
+    std::pair<Key, Value> item(std::forward<Args>(args)...);
+    return iterator(emplaceUnique(const_cast<NodeT *>(hint.current_),
+                                  std::move(item.first), std::move(item.second)).first,
+                    this);
+}
+
+/**
+ * A remove method to remove a specific key from a Binary Search Tree.
+ * Recall: The writeup specifies that if a node has 2 children you
+ * should swap with the pred and then remove.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::remove(const Key &key)
+{
+    NodeT *n = internalFind(key);
+    if (n == NULL)
+        return;
+    unlinkThreads(n);
+    NodeT *p = n->getParent();
+    if (n->getLeft() == NULL && n->getRight() == NULL)
+    {
+        // @condition If leaf node, remove
+        if (p == NULL)
             root_ = NULL; // root node case
         if (p != NULL)
         { // update parent
@@ -534,14 +1247,15 @@ void BinarySearchTree<Key, Value>::remove(const Key &key)
             else
                 p->setRight(NULL);
         }
-        delete n;
+        destroyNode(n);
+        adjustSubtreeSizes(p, -1);
     }
     else if ((n->getLeft() == NULL && n->getRight() != NULL) || (n->getLeft() != NULL && n->getRight() == NULL))
     {
         // @summary 1 child case
 
         // @summary Get child of current node
-        Node<Key, Value> *c;
+        NodeT *c;
         if (n->getLeft() != NULL)
             c = n->getLeft();
         else
@@ -551,12 +1265,12 @@ void BinarySearchTree<Key, Value>::remove(const Key &key)
             // @condition Determine direction of child and set new parent
             if (p->getRight() == n)
             {
-                delete n;
+                destroyNode(n);
                 p->setRight(c);
             }
             else
             {
-                delete n;
+                destroyNode(n);
                 p->setLeft(c);
             }
             c->setParent(p);
@@ -566,17 +1280,18 @@ void BinarySearchTree<Key, Value>::remove(const Key &key)
             // @summary Root case: Promote child to root
             c->setParent(NULL);
             root_ = c;
-            delete n;
+            destroyNode(n);
         }
+        adjustSubtreeSizes(p, -1);
     }
     else
     {
 
         // @summary 2 child case; Swap n with predecessor and remove n; WIll have either 0 or 1 child afterwards
-        Node<Key, Value> *pred = this->pred(n);
+        NodeT *pred = this->pred(n);
         nodeSwap(n, pred);
 
-        Node<Key, Value> *predParent = n->getParent();
+        NodeT *predParent = n->getParent();
 
         // @summary Leaf node case
         if (n->getLeft() == NULL && n->getRight() == NULL)
@@ -585,13 +1300,13 @@ void BinarySearchTree<Key, Value>::remove(const Key &key)
                 predParent->setRight(NULL);
             else
                 predParent->setLeft(NULL);
-            delete n;
+            destroyNode(n);
         }
 
-        else if (n->getLeft() != NULL && n->getRight() == NULL || n->getLeft() == NULL && n->getRight() != NULL) // 1 child
+        else if ((n->getLeft() != NULL && n->getRight() == NULL) || (n->getLeft() == NULL && n->getRight() != NULL)) // 1 child
         {
             // @summary 1 child remaining case
-            Node<Key, Value> *c;
+            NodeT *c;
             if (n->getLeft() != NULL)
             {
                 c = n->getLeft();
@@ -603,28 +1318,29 @@ void BinarySearchTree<Key, Value>::remove(const Key &key)
 
             if (predParent->getRight() == n)
             {
-                delete n;
+                destroyNode(n);
                 predParent->setRight(c);
             }
             else
             {
-                delete n;
+                destroyNode(n);
                 predParent->setLeft(c);
             }
             c->setParent(predParent);
         }
+        adjustSubtreeSizes(predParent, -1);
     }
 }
 
 /*
     Get maximum value in left subtree
 */
-template <class Key, class Value>
-Node<Key, Value> *
-BinarySearchTree<Key, Value>::pred(Node<Key, Value> *current)
+template <class Key, class Value, class Compare, class NodeT, class Alloc>
+NodeT *
+BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::pred(NodeT *current)
 {
     // @summary Get max value of subtree
-    Node<Key, Value> *p = current->getLeft();
+    NodeT *p = current->getLeft();
 
     // @summary If no node found at given position, return NULL
     if (p == NULL)
@@ -640,42 +1356,453 @@ BinarySearchTree<Key, Value>::pred(Node<Key, Value> *current)
  * A method to remove all contents of the tree and
  * reset the values in the tree for use again.
  */
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::clear()
 {
+    // @condition Nothing to destroy per node, so hand whole blocks back at once
+    if (Alloc::bulk_release && std::is_trivially_destructible<NodeT>::value)
+    {
+        alloc_.release();
+        root_ = NULL;
+        first_ = NULL;
+        last_ = NULL;
+        return;
+    }
+
     // clear tree and reset root
     clearSubtree(root_);
     root_ = NULL;
+    first_ = NULL;
+    last_ = NULL;
+    alloc_.release();
+}
+
+/**
+ * Replaces the contents of the tree with the key/value pairs in [first, last).
+ * A range already sorted by strictly increasing key (over forward iterators)
+ * is linked into a perfectly balanced tree in one O(n) pass. Anything else is
+ * first copied and sorted; as with insert, the last value given for a key wins.
+ * Items are copied into nodes exactly once in either case.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+template <typename InputIt>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::assign(InputIt first, InputIt last)
+{
+    clear();
+
+    // @condition Sorted, multi-pass input can be built straight from the range
+    typedef typename std::iterator_traits<InputIt>::iterator_category Category;
+    if constexpr (std::is_base_of<std::forward_iterator_tag, Category>::value)
+    {
+        bool sorted = true;
+        std::size_t n = 0;
+        for (InputIt prev = first, it = first; it != last; prev = it, ++it, ++n)
+        {
+            if (n > 0 && !comp_(prev->first, it->first))
+                sorted = false;
+        }
+        if (sorted)
+        {
+            int height;
+            NodeT *lastBuilt = NULL;
+            root_ = buildSorted(first, n, NULL, height, lastBuilt);
+            last_ = lastBuilt;
+            return;
+        }
+    }
+
+    // @summary Otherwise sort a copy, keeping only the last value for each key
+    std::vector<std::pair<Key, Value> > items(first, last);
+    std::stable_sort(items.begin(), items.end(),
+                     [this](const std::pair<Key, Value> &a, const std::pair<Key, Value> &b)
+                     { return comp_(a.first, b.first); });
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < items.size(); i++)
+    {
+        if (n > 0 && !comp_(items[n - 1].first, items[i].first))
+            items[n - 1].second = std::move(items[i].second);
+        else if (n++ != i)
+            items[n - 1] = std::move(items[i]);
+    }
+
+    // @summary The copy is ours, so its keys and values can be moved into the nodes
+    std::move_iterator<typename std::vector<std::pair<Key, Value> >::iterator> it(items.begin());
+    int height;
+    NodeT *lastBuilt = NULL;
+    root_ = buildSorted(it, n, NULL, height, lastBuilt);
+    last_ = lastBuilt;
+}
+
+/**
+ * Inserts the key/value pairs in [first, last), which should be sorted by
+ * key, as insert would (an existing value is overwritten, and the last value
+ * given for a repeated key wins). Instead of one descent per item, the batch
+ * is merged with the tree's nodes in a single in-order pass, and the existing
+ * nodes plus one new node per new key are relinked into a balanced tree, for
+ * O(n + m) in all. A batch much smaller than the tree is cheaper to insert
+ * one item at a time, so it is. Items that are out of order are set aside
+ * during the merge and inserted normally afterwards.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+template <typename InputIt>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::insert_sorted_batch(InputIt first, InputIt last)
+{
+    // @condition m log n < n: separate inserts touch fewer nodes than a rebuild
+    typedef typename std::iterator_traits<InputIt>::iterator_category Category;
+    std::size_t n = size();
+    std::size_t m = 0; // batch size, when it can be counted without consuming the range
+    if constexpr (std::is_base_of<std::forward_iterator_tag, Category>::value)
+    {
+        m = std::distance(first, last);
+        std::size_t logN = 1;
+        for (std::size_t k = n; k > 1; k /= 2)
+            logN++;
+        if (m * logN < n)
+        {
+            for (; first != last; ++first)
+                insert_or_assign((*first).first, (*first).second);
+            return;
+        }
+    }
+
+    // @summary Merge the batch into the in-order node sequence
+    std::vector<NodeT *> merged;
+    merged.reserve(n + m);
+    std::vector<std::pair<Key, Value> > stragglers;
+    NodeT *next = getSmallestNode();
+    try
+    {
+        for (; first != last; ++first)
+        {
+            const Key &key = (*first).first;
+            while (next != NULL && comp_(next->getKey(), key))
+            {
+                merged.push_back(next);
+                next = successor(next);
+            }
+            if (!merged.empty() && comp_(key, merged.back()->getKey()))
+                stragglers.push_back(std::pair<Key, Value>((*first).first, (*first).second));
+            else if (next != NULL && !comp_(key, next->getKey()))
+                next->setValue((*first).second);
+            else if (!merged.empty() && !comp_(merged.back()->getKey(), key))
+                merged.back()->setValue((*first).second);
+            else
+                merged.push_back(createNode(NULL, (*first).first, (*first).second));
+        }
+    }
+    catch (...)
+    {
+        // @summary Nothing is relinked yet; new nodes are the only parentless ones besides the root
+        for (std::size_t i = 0; i < merged.size(); i++)
+        {
+            if (merged[i]->getParent() == NULL && merged[i] != root_)
+                destroyNode(merged[i]);
+        }
+        throw;
+    }
+    for (; next != NULL; next = successor(next))
+        merged.push_back(next);
+
+    // @summary Relink every node into a balanced tree in one pass
+    typename std::vector<NodeT *>::iterator it = merged.begin();
+    int height;
+    NodeT *lastBuilt = NULL;
+    first_ = NULL;
+    root_ = buildSorted(it, merged.size(), NULL, height, lastBuilt);
+    last_ = lastBuilt;
+    if constexpr (NodeT::threaded)
+    {
+        if (lastBuilt != NULL)
+            lastBuilt->setNext(NULL);
+    }
+
+    for (std::size_t i = 0; i < stragglers.size(); i++)
+        insert_or_assign(std::move(stragglers[i].first), std::move(stragglers[i].second));
+}
+
+/**
+ * Builds a balanced subtree from the next n items of a sorted sequence,
+ * advancing it past them. The middle item becomes the root, so the two
+ * subtrees differ in size (and height) by at most one. Sets height to
+ * the height of the built subtree. last is the most recently built node,
+ * which threaded nodes link to in order. A sequence of NodeT pointers is
+ * linked as is instead of being copied into new nodes.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+template <typename It>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::buildSorted(It &it, std::size_t n, NodeT *parent, int &height, NodeT *&last)
+{
+    if (n == 0)
+    {
+        height = 0;
+        return NULL;
+    }
+
+    // @summary Build left subtree, then the middle node, then the right subtree in key order
+    int leftHeight, rightHeight;
+    NodeT *left = buildSorted(it, n / 2, NULL, leftHeight, last);
+    NodeT *node;
+    if constexpr (std::is_same<typename std::iterator_traits<It>::value_type, NodeT *>::value)
+    {
+        // @condition Relinking nodes we already own
+        node = *it;
+        node->setParent(parent);
+    }
+    else
+    {
+        node = createNode(parent, (*it).first, (*it).second);
+    }
+    ++it;
+    if constexpr (NodeT::threaded)
+    {
+        node->setPrev(last);
+        if (last != NULL)
+            last->setNext(node);
+        else
+            first_ = node;
+    }
+    last = node;
+    NodeT *right = buildSorted(it, n - n / 2 - 1, node, rightHeight, last);
+
+    node->setLeft(left);
+    if (left != NULL)
+        left->setParent(node);
+    node->setRight(right);
+    node->setChildHeights(leftHeight, rightHeight);
+    node->setSubtreeSize(n);
+    height = std::max(leftHeight, rightHeight) + 1;
+    return node;
 }
 
 /**
  * @brief
- * A helper function to remove nodes recursively
+ * A helper function to remove the nodes of n's subtree without recursion,
+ * so that even a tree degenerated into a path of millions of nodes can be
+ * destroyed. Each left child is rotated up in turn, reversing the link to
+ * it, until the node on top has no left child; that node is destroyed and
+ * its right child is next. Every rotation moves one node onto the right
+ * spine for good, so this is O(n) time and O(1) extra memory.
  */
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clearSubtree(Node<Key, Value> *n)
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::clearSubtree(NodeT *n)
 {
-    // Remove subtrees if they exist
+    while (n != NULL)
+    {
+        NodeT *l = n->getLeft();
+        if (l != NULL)
+        {
+            // @summary Rotate l up: its right subtree becomes n's left, n becomes its right
+            n->setLeft(l->getRight());
+            l->setRight(n);
+            n = l;
+        }
+        else
+        {
+            NodeT *r = n->getRight();
+            destroyNode(n);
+            n = r;
+        }
+    }
+}
+
+/**
+ * Builds a node holding key and a value constructed from valueArgs in storage
+ * from the tree's allocator. The storage is handed back if construction throws.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+template <typename KeyArg, typename... ValueArgs>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::createNode(NodeT *parent, KeyArg &&key, ValueArgs &&...valueArgs)
+{
+    void *storage = alloc_.allocate();
+    try
+    {
+        return new (storage) NodeT(parent, std::piecewise_construct,
+                                   std::forward_as_tuple(std::forward<KeyArg>(key)),
+                                   std::forward_as_tuple(std::forward<ValueArgs>(valueArgs)...));
+    }
+    catch (...)
+    {
+        alloc_.deallocate(storage);
+        throw;
+    }
+}
+
+/**
+ * Destroys a node and returns its storage to the tree's allocator.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::destroyNode(NodeT *n)
+{
+    n->~NodeT();
+    alloc_.deallocate(n);
+}
+
+/**
+ * The common insertion path. Searches for key first, starting from hint
+ * (NULL for end()), and only if it is absent builds the new node from the
+ * forwarded arguments and links it in. Returns the node holding key and
+ * whether it was inserted; when it was not, key and valueArgs are left untouched.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+template <typename KeyArg, typename... ValueArgs>
+std::pair<NodeT *, bool> BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::emplaceUnique(NodeT *hint, KeyArg &&key, ValueArgs &&...valueArgs)
+{
+    NodeT *p = NULL;
+    bool setLeftChild = false;
+    NodeT *n = findHintedPosition(hint, key, p, setLeftChild);
     if (n != NULL)
+        return std::make_pair(n, false);
+
+    n = createNode(p, std::forward<KeyArg>(key), std::forward<ValueArgs>(valueArgs)...);
+    linkNewNode(n, p, setLeftChild);
+    return std::make_pair(n, true);
+}
+
+/**
+ * Links the new leaf n below parent (or as the root if parent is NULL),
+ * then updates subtree sizes and threads and gives subclasses a chance to
+ * rebalance through insertFix.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::linkNewNode(NodeT *n, NodeT *parent, bool setLeftChild)
+{
+    // @condition Determine direction of child and set new parent
+    if (parent == NULL)
+        root_ = n;
+    else if (setLeftChild)
+        parent->setLeft(n);
+    else
+        parent->setRight(n);
+    adjustSubtreeSizes(parent, 1);
+    linkThreads(n);
+    insertFix(n);
+}
+
+/**
+ * An unbalanced tree does nothing after an insert.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::insertFix(NodeT *n)
+{
+}
+
+/**
+ * Splices a freshly linked leaf n into the in-order thread, between its
+ * parent and the parent's old neighbour on n's side. Only threaded trees
+ * keep the thread; every tree notes a new largest node here.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::linkThreads(NodeT *n)
+{
+    if (n->getParent() == last_ && (last_ == NULL || last_->getRight() == n))
+        last_ = n;
+
+    if constexpr (NodeT::threaded)
     {
-        clearSubtree(n->getRight());
-        clearSubtree(n->getLeft());
+        NodeT *p = n->getParent();
+        NodeT *prev = NULL;
+        NodeT *next = NULL;
+        if (p != NULL && p->getLeft() == n)
+        {
+            prev = p->getPrev();
+            next = p;
+        }
+        else if (p != NULL)
+        {
+            prev = p;
+            next = p->getNext();
+        }
+        n->setPrev(prev);
+        n->setNext(next);
+        if (prev != NULL)
+            prev->setNext(n);
+        else
+            first_ = n;
+        if (next != NULL)
+            next->setPrev(n);
     }
-    delete n;
+}
+
+/**
+ * Takes n out of the in-order thread before it is removed (threaded trees
+ * only), and hands the largest-node role to its predecessor if needed.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::unlinkThreads(NodeT *n)
+{
+    if (n == last_)
+        last_ = predecessor(n);
+
+    if constexpr (NodeT::threaded)
+    {
+        if (n->getPrev() != NULL)
+            n->getPrev()->setNext(n->getNext());
+        else
+            first_ = n->getNext();
+        if (n->getNext() != NULL)
+            n->getNext()->setPrev(n->getPrev());
+    }
+}
+
+/**
+ * Returns the number of nodes in n's subtree, 0 for an empty one.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+std::size_t BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::subtreeSize(const NodeT *n)
+{
+    return n == NULL ? 0 : n->getSubtreeSize();
+}
+
+/**
+ * Returns the k-th smallest node (counting from 0) of n's subtree,
+ * or NULL if the subtree holds k nodes or fewer.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::selectNode(NodeT *n, std::size_t k)
+{
+    while (n != NULL)
+    {
+        std::size_t leftSize = subtreeSize(n->getLeft());
+        if (k < leftSize)
+            n = n->getLeft();
+        else if (k == leftSize)
+            return n;
+        else
+        {
+            k -= leftSize + 1;
+            n = n->getRight();
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Adds delta to the subtree size of n and of every ancestor of n,
+ * after a node was linked below n (delta 1) or unlinked (delta -1).
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::adjustSubtreeSizes(NodeT *n, int delta)
+{
+    for (; n != NULL; n = n->getParent())
+        n->setSubtreeSize(n->getSubtreeSize() + delta);
 }
 
 /**
  * A helper function to find the smallest node in the tree.
  */
-template <typename Key, typename Value>
-Node<Key, Value> *BinarySearchTree<Key, Value>::getSmallestNode() const
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::getSmallestNode() const
 {
+    // Threaded trees keep track of it
+    if constexpr (NodeT::threaded)
+        return first_;
+
     // Base case: Return NULL if root is empty
     if (root_ == NULL)
         return NULL;
 
     // Otherwise, find/return the leftmost node
-    Node<Key, Value> *n = root_;
+    NodeT *n = root_;
     while (n->getLeft() != NULL)
     {
         n = n->getLeft();
@@ -683,30 +1810,237 @@ Node<Key, Value> *BinarySearchTree<Key, Value>::getSmallestNode() const
     return n;
 }
 
+/**
+ * A helper function to find the largest node in the tree.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::getLargestNode() const
+{
+    return last_;
+}
+
+/**
+ * Returns the next node in order after current, or NULL if it is the last.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::successor(NodeT *current)
+{
+    // @condition Threaded nodes link straight to their successor
+    if constexpr (NodeT::threaded)
+        return current->getNext();
+
+    // @condition If right tree exists, find successor
+    if (current->getRight() != NULL)
+    {
+        current = current->getRight();
+        while (current->getLeft() != NULL)
+        {
+            current = current->getLeft();
+        }
+        return current;
+    }
+
+    // Right subtree cases
+    while (current->getParent() && current->getParent()->getRight() == current)
+        current = current->getParent(); // If right child, go back one node
+    return current->getParent();
+}
+
+/**
+ * Returns the previous node in order before current, or NULL if it is the first.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::predecessor(NodeT *current)
+{
+    if constexpr (NodeT::threaded)
+        return current->getPrev();
+
+    // @condition If left tree exists, the predecessor is its maximum
+    if (current->getLeft() != NULL)
+        return pred(current);
+
+    // Left subtree cases
+    while (current->getParent() && current->getParent()->getLeft() == current)
+        current = current->getParent(); // If left child, go back one node
+    return current->getParent();
+}
+
 /**
  * @brief Helper function to get node with given key
  *
- * @tparam Key
- * @tparam Value
- * @param key
- * @return Node<Key, Value>*
+ * Descends iteratively with a single comparison per level to the first
+ * node whose key is not less than k; k is found only if that node's key
+ * is not greater than k either.
+ *
+ * @tparam K Key, or any type Compare can order against Key
+ * @param k key to look for
+ * @param n root of the subtree to search
+ * @return NodeT* node holding k, or NULL
  */
-template <typename Key, typename Value>
-Node<Key, Value> *BinarySearchTree<Key, Value>::getNode(const Key &k, Node<Key, Value> *n) const
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+template <typename K>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::getNode(const K &k, NodeT *n) const
 {
-    // @condition If node is empty, return null
-    if (n == NULL)
-        return NULL;
+    NodeT *candidate = lowerBoundNode(k, n);
+    if (candidate != NULL && !comp_(k, candidate->getKey()))
+        return candidate;
+    return NULL;
+}
 
-    // @condition If keys match, return node
-    if (n->getKey() == k)
-        return n;
+/**
+ * Asks the CPU to start loading n, which a lookup will read soon. NULL is fine.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::prefetchNode(const NodeT *n)
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(n);
+#else
+    (void)n;
+#endif
+}
 
-    // @condition If key less than n, go left. Otherwise, go right
-    if (n->getKey() > k)
-        return getNode(k, n->getLeft());
+/**
+ * Returns the node with the smallest key not less than k in n's subtree,
+ * or NULL if every key there is less than k.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+template <typename K>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::lowerBoundNode(const K &k, NodeT *n) const
+{
+    NodeT *candidate = NULL;
+    while (n != NULL)
+    {
+        // @condition If n's key is less than k, go right. Otherwise, n might be the answer; go left
+        if (comp_(n->getKey(), k))
+            n = n->getRight();
+        else
+        {
+            candidate = n;
+            n = n->getLeft();
+        }
+    }
+    return candidate;
+}
+
+/**
+ * Returns the node with the smallest key greater than k, or NULL.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::upperBoundNode(const Key &k) const
+{
+    NodeT *candidate = NULL;
+    NodeT *n = root_;
+    while (n != NULL)
+    {
+        if (comp_(k, n->getKey()))
+        {
+            candidate = n;
+            n = n->getLeft();
+        }
+        else
+            n = n->getRight();
+    }
+    return candidate;
+}
+
+/**
+ * Returns the node with the largest key not greater than k, or NULL.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::floorNode(const Key &k) const
+{
+    NodeT *candidate = NULL;
+    NodeT *n = root_;
+    while (n != NULL)
+    {
+        if (comp_(k, n->getKey()))
+            n = n->getLeft();
+        else
+        {
+            candidate = n;
+            n = n->getRight();
+        }
+    }
+    return candidate;
+}
+
+/**
+ * @brief Helper function to find where key belongs
+ *
+ * Descends with a single comparison per level. Returns the node already
+ * holding key, if any. Otherwise returns NULL and sets parent/setLeftChild
+ * to the leaf position a new node for key should be linked into (parent is
+ * NULL for an empty tree).
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::findInsertPosition(const Key &key, NodeT *&parent, bool &setLeftChild) const
+{
+    NodeT *n = root_;
+    NodeT *maybeEqual = NULL; // last node we went right from; its key is <= key
+    parent = NULL;
+    setLeftChild = false;
+    while (n != NULL)
+    {
+        parent = n;
+        if (comp_(key, n->getKey()))
+        {
+            n = n->getLeft();
+            setLeftChild = true;
+        }
+        else
+        {
+            maybeEqual = n;
+            n = n->getRight();
+            setLeftChild = false;
+        }
+    }
+    if (maybeEqual != NULL && !comp_(maybeEqual->getKey(), key))
+        return maybeEqual;
+    return NULL;
+}
+
+/**
+ * Like findInsertPosition, but first tries the gap just before hint (NULL
+ * meaning end()) and then the one just after it. Each check takes one or two
+ * comparisons against hint and its in-order neighbour. Between two adjacent
+ * nodes, either the later one has no left child or the earlier one has no
+ * right child, so a key that fits the gap is linked there directly. Only
+ * when it does not fit does this fall back to a full descent from the root.
+ * Since end() is the default hint, every insert past the largest key is an
+ * O(1) append.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::findHintedPosition(NodeT *hint, const Key &key, NodeT *&parent, bool &setLeftChild) const
+{
+    // @condition key belongs before hint; check that it is after hint's predecessor
+    if (hint == NULL || comp_(key, hint->getKey()))
+    {
+        NodeT *before = (hint == NULL) ? last_ : predecessor(hint);
+        if (before == NULL || comp_(before->getKey(), key))
+        {
+            setLeftChild = (hint != NULL && hint->getLeft() == NULL);
+            parent = setLeftChild ? hint : before;
+            return NULL;
+        }
+    }
+    // @condition key belongs after hint; check that it is before hint's successor
+    else if (comp_(hint->getKey(), key))
+    {
+        NodeT *after = successor(hint);
+        if (after == NULL || comp_(key, after->getKey()))
+        {
+            setLeftChild = (hint->getRight() != NULL);
+            parent = setLeftChild ? after : hint;
+            return NULL;
+        }
+    }
+    // @condition Neither is smaller, so hint holds key
     else
-        return getNode(k, n->getRight());
+    {
+        return hint;
+    }
+    return findInsertPosition(key, parent, setLeftChild);
 }
 
 /**
@@ -714,71 +2048,127 @@ Node<Key, Value> *BinarySearchTree<Key, Value>::getNode(const Key &k, Node<Key,
  * return a pointer to it or NULL if no item with that key
  * exists
  */
-template <typename Key, typename Value>
-Node<Key, Value> *BinarySearchTree<Key, Value>::internalFind(const Key &key) const
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+NodeT *BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::internalFind(const Key &key) const
 {
     return this->getNode(key, root_);
 }
 
-// @summary Get height of tree
-template <typename Key, typename Value>
-int BinarySearchTree<Key, Value>::getHeight(Node<Key, Value> *n) const
+/**
+ * Returns the height of n's subtree. Walks the subtree in order through
+ * parent links, knowing where it came from by the node it just left, so
+ * it needs O(1) extra memory and no recursion however deep the tree is.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+int BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::getHeight(NodeT *n) const
 {
     if (n == NULL)
         return 0;
-    int leftHeight = getHeight(n->getLeft());
-    int rightHeight = getHeight(n->getRight());
-    return std::max(leftHeight, rightHeight) + 1;
+    int height = 1;
+    int depth = 1;
+    NodeT *from = n->getParent();
+    NodeT *cur = n;
+    while (true)
+    {
+        NodeT *next;
+        // @condition Coming down: visit the left subtree, then the right one
+        if (from == cur->getParent() && cur->getLeft() != NULL)
+            next = cur->getLeft();
+        else if (from != cur->getRight() && cur->getRight() != NULL)
+            next = cur->getRight();
+        // @condition Both subtrees are done, so go back up (and stop at n)
+        else if (cur == n)
+            break;
+        else
+            next = cur->getParent();
+
+        depth += (next == cur->getParent()) ? -1 : 1;
+        height = std::max(height, depth);
+        from = cur;
+        cur = next;
+    }
+    return height;
 }
 
 /**
- * Check if tree is balanced
- * */
-template <typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::checkBalance(Node<Key, Value> *n) const
+ * Gathers the tree's shape metrics in a single iterative post-order pass.
+ * Each node's height is computed once from its children's, so this costs
+ * O(n) time and O(height) extra memory.
+ */
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+TreeShape BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::shape() const
 {
-    // @summary If n is empty, return true as default
-    if (n == NULL)
-        return true;
+    TreeShape result;
+    result.height = 0;
+    result.nodeCount = 0;
+    result.maxSkew = 0;
+
+    // @summary Nodes still to visit (second = children already pushed) and finished subtree heights
+    std::vector<std::pair<NodeT *, bool> > pending;
+    std::vector<int> heights;
+    pending.push_back(std::make_pair(root_, false));
+    while (!pending.empty())
+    {
+        NodeT *n = pending.back().first;
+        bool expanded = pending.back().second;
+        pending.pop_back();
 
-    // @summary Get height of each subtree and compare
-    int LSubtreeHeight = getHeight(n->getLeft());
-    int RSubtreeHeight = getHeight(n->getRight());
-    if (abs(LSubtreeHeight - RSubtreeHeight) >= 2)
-        return false;
-    return checkBalance(n->getLeft()) && checkBalance(n->getRight());
+        if (n == NULL)
+        {
+            heights.push_back(0);
+        }
+        else if (!expanded)
+        {
+            // @summary Revisit n after both children, left one finishing first
+            pending.push_back(std::make_pair(n, true));
+            pending.push_back(std::make_pair(n->getRight(), false));
+            pending.push_back(std::make_pair(n->getLeft(), false));
+        }
+        else
+        {
+            int rightHeight = heights.back();
+            heights.pop_back();
+            int leftHeight = heights.back();
+            heights.pop_back();
+            result.maxSkew = std::max(result.maxSkew, abs(leftHeight - rightHeight));
+            result.nodeCount++;
+            heights.push_back(std::max(leftHeight, rightHeight) + 1);
+        }
+    }
+    result.height = heights.back();
+    return result;
 }
 
 /**
  * Return true iff the BST is balanced.
  */
-template <typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+bool BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::isBalanced() const
 {
-    return checkBalance(root_);
+    return shape().maxSkew < 2;
 }
 
-template <typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap(Node<Key, Value> *n1, Node<Key, Value> *n2)
+template <typename Key, typename Value, typename Compare, typename NodeT, typename Alloc>
+void BinarySearchTree<Key, Value, Compare, NodeT, Alloc>::nodeSwap(NodeT *n1, NodeT *n2)
 {
     if ((n1 == n2) || (n1 == NULL) || (n2 == NULL))
     {
         return;
     }
-    Node<Key, Value> *n1p = n1->getParent();
-    Node<Key, Value> *n1r = n1->getRight();
-    Node<Key, Value> *n1lt = n1->getLeft();
+    NodeT *n1p = n1->getParent();
+    NodeT *n1r = n1->getRight();
+    NodeT *n1lt = n1->getLeft();
     bool n1isLeft = false;
     if (n1p != NULL && (n1 == n1p->getLeft()))
         n1isLeft = true;
-    Node<Key, Value> *n2p = n2->getParent();
-    Node<Key, Value> *n2r = n2->getRight();
-    Node<Key, Value> *n2lt = n2->getLeft();
+    NodeT *n2p = n2->getParent();
+    NodeT *n2r = n2->getRight();
+    NodeT *n2lt = n2->getLeft();
     bool n2isLeft = false;
     if (n2p != NULL && (n2 == n2p->getLeft()))
         n2isLeft = true;
 
-    Node<Key, Value> *temp;
+    NodeT *temp;
     temp = n1->getParent();
     n1->setParent(n2->getParent());
     n2->setParent(temp);
@@ -791,6 +2181,11 @@ void BinarySearchTree<Key, Value>::nodeSwap(Node<Key, Value> *n1, Node<Key, Valu
     n1->setRight(n2->getRight());
     n2->setRight(temp);
 
+    // Subtree sizes belong to the position, not the item
+    std::size_t tempSize = n1->getSubtreeSize();
+    n1->setSubtreeSize(n2->getSubtreeSize());
+    n2->setSubtreeSize(tempSize);
+
     if ((n1r != NULL && n1r == n2))
     {
         n2->setRight(n1);
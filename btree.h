@@ -0,0 +1,959 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <algorithm>
+#include <bitset>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * SSE2 compares for the arithmetic key types that have them. For each type,
+ * less(x, k) and greater(x, k) compare every lane of x against k and return
+ * a bit mask with bitsPerLane bits per lane. Other types are not available
+ * and fall back to a scalar loop.
+ */
+template <typename T>
+struct SimdLanes
+{
+    static const bool available = false;
+};
+
+#ifdef __SSE2__
+template <>
+struct SimdLanes<signed char>
+{
+    static const bool available = true;
+    static const unsigned lanes = 16, bitsPerLane = 1;
+    static __m128i splat(signed char k) { return _mm_set1_epi8(k); }
+    static __m128i load(const void *p) { return _mm_loadu_si128((const __m128i *)p); }
+    static unsigned less(__m128i x, __m128i k) { return _mm_movemask_epi8(_mm_cmpgt_epi8(k, x)); }
+    static unsigned greater(__m128i x, __m128i k) { return _mm_movemask_epi8(_mm_cmpgt_epi8(x, k)); }
+};
+
+#if CHAR_MIN < 0
+template <>
+struct SimdLanes<char> : SimdLanes<signed char>
+{
+};
+#endif
+
+template <>
+struct SimdLanes<short>
+{
+    static const bool available = true;
+    static const unsigned lanes = 8, bitsPerLane = 2;
+    static __m128i splat(short k) { return _mm_set1_epi16(k); }
+    static __m128i load(const void *p) { return _mm_loadu_si128((const __m128i *)p); }
+    static unsigned less(__m128i x, __m128i k) { return _mm_movemask_epi8(_mm_cmpgt_epi16(k, x)); }
+    static unsigned greater(__m128i x, __m128i k) { return _mm_movemask_epi8(_mm_cmpgt_epi16(x, k)); }
+};
+
+template <>
+struct SimdLanes<int>
+{
+    static const bool available = true;
+    static const unsigned lanes = 4, bitsPerLane = 1;
+    static __m128i splat(int k) { return _mm_set1_epi32(k); }
+    static __m128i load(const void *p) { return _mm_loadu_si128((const __m128i *)p); }
+    static unsigned less(__m128i x, __m128i k) { return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(k, x))); }
+    static unsigned greater(__m128i x, __m128i k) { return _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(x, k))); }
+};
+
+template <>
+struct SimdLanes<float>
+{
+    static const bool available = true;
+    static const unsigned lanes = 4, bitsPerLane = 1;
+    static __m128 splat(float k) { return _mm_set1_ps(k); }
+    static __m128 load(const void *p) { return _mm_loadu_ps((const float *)p); }
+    static unsigned less(__m128 x, __m128 k) { return _mm_movemask_ps(_mm_cmplt_ps(x, k)); }
+    static unsigned greater(__m128 x, __m128 k) { return _mm_movemask_ps(_mm_cmpgt_ps(x, k)); }
+};
+
+template <>
+struct SimdLanes<double>
+{
+    static const bool available = true;
+    static const unsigned lanes = 2, bitsPerLane = 1;
+    static __m128d splat(double k) { return _mm_set1_pd(k); }
+    static __m128d load(const void *p) { return _mm_loadu_pd((const double *)p); }
+    static unsigned less(__m128d x, __m128d k) { return _mm_movemask_pd(_mm_cmplt_pd(x, k)); }
+    static unsigned greater(__m128d x, __m128d k) { return _mm_movemask_pd(_mm_cmpgt_pd(x, k)); }
+};
+#endif
+
+/**
+ * Searches the sorted keys of one B-tree node. count(keys, n, key, comp,
+ * orEqual) returns how many of keys[0 .. n) are less than key (or not
+ * greater, if orEqual), i.e. the lower (or upper) bound's index.
+ *
+ * The general version binary searches. Arithmetic keys ordered by
+ * std::less scan the whole node instead, a vector of keys per compare where
+ * SimdLanes has them: for nodes of a few dozen keys that beats a binary
+ * search's unpredictable branches. Such nodes pad their key arrays to a
+ * multiple of 16 keys so the scan can always load full vectors.
+ */
+template <typename Key, typename Compare,
+          bool Scan = std::is_arithmetic<Key>::value && std::is_same<Compare, std::less<Key> >::value>
+struct BTreeNodeSearch
+{
+    static std::size_t count(const Key *keys, std::size_t n, const Key &key, const Compare &comp, bool orEqual)
+    {
+        if (orEqual)
+            return std::upper_bound(keys, keys + n, key, comp) - keys;
+        return std::lower_bound(keys, keys + n, key, comp) - keys;
+    }
+};
+
+template <typename Key, typename Compare>
+struct BTreeNodeSearch<Key, Compare, true>
+{
+    static std::size_t count(const Key *keys, std::size_t n, const Key &key, const Compare &, bool orEqual)
+    {
+        if constexpr (SimdLanes<Key>::available)
+        {
+            typedef SimdLanes<Key> L;
+            auto k = L::splat(key);
+            std::size_t c = 0;
+            for (std::size_t i = 0; i < n; i += L::lanes)
+            {
+                auto x = L::load(keys + i);
+                unsigned bits = orEqual ? L::greater(x, k) : L::less(x, k);
+
+                // @summary Drop the lanes past n in the last vector
+                std::size_t valid = std::min<std::size_t>(L::lanes, n - i) * L::bitsPerLane;
+                if (valid < 32)
+                    bits &= (1u << valid) - 1;
+                c += std::bitset<32>(bits).count() / L::bitsPerLane;
+            }
+            // @condition Counted the keys greater than key; the rest are not greater
+            return orEqual ? n - c : c;
+        }
+        else
+        {
+            std::size_t c = 0;
+            for (std::size_t i = 0; i < n; i++)
+                c += orEqual ? !(key < keys[i]) : (keys[i] < key);
+            return c;
+        }
+    }
+};
+
+/**
+ * A B+ tree map with the same interface as BinarySearchTree: insert, remove,
+ * find, operator[] and bidirectional iterators in key order.
+ *
+ * Every node holds up to B keys in a sorted array, so a lookup reads about
+ * log_B n nodes of a few cache lines each, rather than log_2 n scattered
+ * binary nodes that each hold one key/value pair, three pointers and a
+ * subtree size. The items live in the leaves, which are chained for
+ * iteration; inner nodes hold only separator keys, where keys[i] is at most
+ * the smallest key under children[i + 1]. Every node but the root stays at
+ * least half full.
+ *
+ * Keys and values live in separate arrays, so that node searches scan
+ * nothing but keys (see BTreeNodeSearch). An iterator therefore yields a
+ * std::pair<const Key &, Value &> of references rather than a reference to
+ * a stored pair; it->first and it->second work as with the other trees.
+ * Key and Value must be default constructible.
+ */
+template <typename Key, typename Value, std::size_t B = 32, typename Compare = std::less<Key> >
+class BTree
+{
+    static_assert(B >= 4, "B-tree nodes need room for at least 4 keys");
+
+    struct Leaf;
+
+public:
+    typedef Compare key_compare;
+
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key &, Value &> reference;
+
+        // Holds the pair of references that operator-> points into
+        class pointer
+        {
+        public:
+            explicit pointer(const reference &ref) : ref_(ref) {}
+            const reference *operator->() const { return &ref_; }
+
+        private:
+            reference ref_;
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator &rhs) const;
+        bool operator!=(const iterator &rhs) const;
+
+        iterator &operator++();
+        iterator operator++(int);
+        iterator &operator--();
+        iterator operator--(int);
+
+    private:
+        friend class BTree<Key, Value, B, Compare>;
+        iterator(Leaf *leaf, std::size_t index, const BTree<Key, Value, B, Compare> *tree);
+        Leaf *leaf_;
+        std::size_t index_;
+        const BTree<Key, Value, B, Compare> *tree_; // lets --end() find the last item
+    };
+
+    BTree();
+    explicit BTree(const Compare &comp);
+    ~BTree();
+
+    void insert(const std::pair<const Key, Value> &keyValuePair);
+    void remove(const Key &key);
+    void clear();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key &key) const;
+    iterator lower_bound(const Key &key) const;
+    iterator upper_bound(const Key &key) const;
+    Value &operator[](const Key &key);
+    Value const &operator[](const Key &key) const;
+
+    bool isBalanced() const;
+    bool empty() const;
+    std::size_t size() const;
+    int height() const;
+
+private:
+    // A tree owns its nodes, so it cannot be copied
+    BTree(const BTree &);
+    BTree &operator=(const BTree &);
+
+    static const std::size_t MIN_KEYS = B / 2;
+    static const std::size_t KEY_SLOTS = std::is_arithmetic<Key>::value ? (B + 15) / 16 * 16 : B;
+
+    struct NodeBase
+    {
+        explicit NodeBase(bool isLeaf) : keys(), count(0), leaf(isLeaf) {}
+
+        Key keys[KEY_SLOTS];
+        std::size_t count; // keys in use
+        bool leaf;
+    };
+
+    struct Leaf : NodeBase
+    {
+        Leaf() : NodeBase(true), values(), prev(NULL), next(NULL) {}
+
+        Value values[B];
+        Leaf *prev;
+        Leaf *next;
+    };
+
+    struct Inner : NodeBase
+    {
+        Inner() : NodeBase(false), children() {}
+
+        NodeBase *children[B + 1]; // count + 1 in use
+    };
+
+    // A node split in two while inserting; right is NULL if nothing split
+    struct Split
+    {
+        Split() : separator(), right(NULL) {}
+
+        Key separator;
+        NodeBase *right;
+    };
+
+    std::size_t keyIndex(const NodeBase *n, const Key &key, bool orEqual) const;
+    Leaf *findLeaf(const Key &key) const;
+    bool insertInto(NodeBase *n, const std::pair<const Key, Value> &keyValuePair, Split &split);
+    bool insertIntoLeaf(Leaf *leaf, std::size_t i, const std::pair<const Key, Value> &keyValuePair, Split &split);
+    void insertIntoInner(Inner *inner, std::size_t i, const Split &childSplit, Split &split);
+    bool removeFrom(NodeBase *n, const Key &key);
+    void fixUnderflow(Inner *parent, std::size_t i);
+    void borrowFromLeft(Inner *parent, std::size_t i);
+    void borrowFromRight(Inner *parent, std::size_t i);
+    void mergeChildren(Inner *parent, std::size_t i);
+    void destroySubtree(NodeBase *n);
+    bool checkNode(const NodeBase *n, int depth, int &leafDepth, const Key *lo, const Key *hi,
+                   std::size_t &items) const;
+
+    NodeBase *root_;
+    Leaf *first_;
+    Leaf *last_;
+    std::size_t size_;
+    int height_;
+    Compare comp_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the iterator class.
+  -----------------------------------------------
+*/
+
+template <class Key, class Value, std::size_t B, class Compare>
+BTree<Key, Value, B, Compare>::iterator::iterator() : leaf_(NULL), index_(0), tree_(NULL)
+{
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+BTree<Key, Value, B, Compare>::iterator::iterator(Leaf *leaf, std::size_t index, const BTree<Key, Value, B, Compare> *tree)
+    : leaf_(leaf), index_(index), tree_(tree)
+{
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator::reference BTree<Key, Value, B, Compare>::iterator::operator*() const
+{
+    return reference(leaf_->keys[index_], leaf_->values[index_]);
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator::pointer BTree<Key, Value, B, Compare>::iterator::operator->() const
+{
+    return pointer(**this);
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+bool BTree<Key, Value, B, Compare>::iterator::operator==(const iterator &rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+bool BTree<Key, Value, B, Compare>::iterator::operator!=(const iterator &rhs) const
+{
+    return !(*this == rhs);
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator &BTree<Key, Value, B, Compare>::iterator::operator++()
+{
+    if (++index_ == leaf_->count)
+    {
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator BTree<Key, Value, B, Compare>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/**
+ * Steps back to the previous item; --end() is the last item
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator &BTree<Key, Value, B, Compare>::iterator::operator--()
+{
+    if (leaf_ == NULL)
+        leaf_ = tree_->last_;
+    else if (index_ == 0)
+        leaf_ = leaf_->prev;
+    else
+    {
+        index_--;
+        return *this;
+    }
+    index_ = leaf_->count - 1;
+    return *this;
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator BTree<Key, Value, B, Compare>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  -----------------------------------------------
+  Begin implementations for the BTree class.
+  -----------------------------------------------
+*/
+
+template <class Key, class Value, std::size_t B, class Compare>
+BTree<Key, Value, B, Compare>::BTree() : root_(NULL), first_(NULL), last_(NULL), size_(0), height_(0), comp_()
+{
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+BTree<Key, Value, B, Compare>::BTree(const Compare &comp)
+    : root_(NULL), first_(NULL), last_(NULL), size_(0), height_(0), comp_(comp)
+{
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+BTree<Key, Value, B, Compare>::~BTree()
+{
+    clear();
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+bool BTree<Key, Value, B, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+std::size_t BTree<Key, Value, B, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+ * Returns the number of node levels, 0 for an empty tree
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+int BTree<Key, Value, B, Compare>::height() const
+{
+    return height_;
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator BTree<Key, Value, B, Compare>::begin() const
+{
+    return iterator(first_, 0, this);
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator BTree<Key, Value, B, Compare>::end() const
+{
+    return iterator(NULL, 0, this);
+}
+
+/**
+ * Returns the index of the first key in n that is not less than key (or,
+ * if orEqual, greater than key). In an inner node, that is the index of the
+ * child to descend into when orEqual is set.
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+std::size_t BTree<Key, Value, B, Compare>::keyIndex(const NodeBase *n, const Key &key, bool orEqual) const
+{
+    return BTreeNodeSearch<Key, Compare>::count(n->keys, n->count, key, comp_, orEqual);
+}
+
+/**
+ * Returns the leaf key belongs in, or NULL for an empty tree
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::Leaf *BTree<Key, Value, B, Compare>::findLeaf(const Key &key) const
+{
+    NodeBase *n = root_;
+    if (n == NULL)
+        return NULL;
+    while (!n->leaf)
+        n = static_cast<Inner *>(n)->children[keyIndex(n, key, true)];
+    return static_cast<Leaf *>(n);
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator BTree<Key, Value, B, Compare>::find(const Key &key) const
+{
+    iterator it = lower_bound(key);
+    if (it == end() || comp_(key, it.leaf_->keys[it.index_]))
+        return end();
+    return it;
+}
+
+/**
+ * Returns an iterator to the first item whose key is not less than key,
+ * or the end iterator if there is none
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator BTree<Key, Value, B, Compare>::lower_bound(const Key &key) const
+{
+    Leaf *leaf = findLeaf(key);
+    if (leaf == NULL)
+        return end();
+    std::size_t i = keyIndex(leaf, key, false);
+
+    // @condition Everything in this leaf is smaller: the answer starts the next one
+    if (i == leaf->count)
+        return iterator(leaf->next, 0, this);
+    return iterator(leaf, i, this);
+}
+
+/**
+ * Returns an iterator to the first item whose key is greater than key,
+ * or the end iterator if there is none
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+typename BTree<Key, Value, B, Compare>::iterator BTree<Key, Value, B, Compare>::upper_bound(const Key &key) const
+{
+    Leaf *leaf = findLeaf(key);
+    if (leaf == NULL)
+        return end();
+    std::size_t i = keyIndex(leaf, key, true);
+    if (i == leaf->count)
+        return iterator(leaf->next, 0, this);
+    return iterator(leaf, i, this);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+Value &BTree<Key, Value, B, Compare>::operator[](const Key &key)
+{
+    iterator it = find(key);
+    if (it == end())
+        throw std::out_of_range("Invalid key");
+    return it.leaf_->values[it.index_];
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+Value const &BTree<Key, Value, B, Compare>::operator[](const Key &key) const
+{
+    iterator it = find(key);
+    if (it == end())
+        throw std::out_of_range("Invalid key");
+    return it.leaf_->values[it.index_];
+}
+
+/**
+ * Inserts keyValuePair, or overwrites the value if the key is already
+ * present. Full nodes split on the way back up; a root split adds a level.
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+void BTree<Key, Value, B, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    if (root_ == NULL)
+    {
+        Leaf *leaf = new Leaf();
+        root_ = first_ = last_ = leaf;
+        height_ = 1;
+    }
+
+    Split split;
+    if (insertInto(root_, keyValuePair, split))
+        size_++;
+    if (split.right != NULL)
+    {
+        Inner *root = new Inner();
+        root->keys[0] = split.separator;
+        root->children[0] = root_;
+        root->children[1] = split.right;
+        root->count = 1;
+        root_ = root;
+        height_++;
+    }
+}
+
+/**
+ * Inserts into the subtree at n and returns whether the key was new. If n
+ * had to split, split receives the new right half and its separator.
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+bool BTree<Key, Value, B, Compare>::insertInto(NodeBase *n, const std::pair<const Key, Value> &keyValuePair, Split &split)
+{
+    if (n->leaf)
+    {
+        Leaf *leaf = static_cast<Leaf *>(n);
+        std::size_t i = keyIndex(leaf, keyValuePair.first, false);
+
+        // @condition If key is the same, update value
+        if (i < leaf->count && !comp_(keyValuePair.first, leaf->keys[i]))
+        {
+            leaf->values[i] = keyValuePair.second;
+            return false;
+        }
+        return insertIntoLeaf(leaf, i, keyValuePair, split);
+    }
+
+    Inner *inner = static_cast<Inner *>(n);
+    std::size_t i = keyIndex(inner, keyValuePair.first, true);
+    Split childSplit;
+    bool inserted = insertInto(inner->children[i], keyValuePair, childSplit);
+    if (childSplit.right != NULL)
+        insertIntoInner(inner, i, childSplit, split);
+    return inserted;
+}
+
+/**
+ * Puts a new item at index i of leaf, splitting a full leaf into two
+ * halves of (B + 1) / 2 items, rounded up on the left.
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+bool BTree<Key, Value, B, Compare>::insertIntoLeaf(Leaf *leaf, std::size_t i, const std::pair<const Key, Value> &keyValuePair,
+                                                   Split &split)
+{
+    if (leaf->count < B)
+    {
+        std::move_backward(leaf->keys + i, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+        std::move_backward(leaf->values + i, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+        leaf->keys[i] = keyValuePair.first;
+        leaf->values[i] = keyValuePair.second;
+        leaf->count++;
+        return true;
+    }
+
+    // @summary Item j of the combined B + 1 items is old j below i, the new item at i, old j - 1 above
+    Leaf *right = new Leaf();
+    const std::size_t leftCount = (B + 2) / 2;
+    for (std::size_t j = leftCount; j <= B; j++)
+    {
+        std::size_t d = j - leftCount;
+        if (j == i)
+        {
+            right->keys[d] = keyValuePair.first;
+            right->values[d] = keyValuePair.second;
+        }
+        else
+        {
+            std::size_t src = (j < i) ? j : j - 1;
+            right->keys[d] = std::move(leaf->keys[src]);
+            right->values[d] = std::move(leaf->values[src]);
+        }
+    }
+    right->count = B + 1 - leftCount;
+    if (i < leftCount)
+    {
+        std::move_backward(leaf->keys + i, leaf->keys + leftCount - 1, leaf->keys + leftCount);
+        std::move_backward(leaf->values + i, leaf->values + leftCount - 1, leaf->values + leftCount);
+        leaf->keys[i] = keyValuePair.first;
+        leaf->values[i] = keyValuePair.second;
+    }
+    for (std::size_t j = leftCount; j < B; j++)
+        leaf->values[j] = Value();
+    leaf->count = leftCount;
+
+    // @summary Chain right in after leaf
+    right->prev = leaf;
+    right->next = leaf->next;
+    if (leaf->next != NULL)
+        leaf->next->prev = right;
+    else
+        last_ = right;
+    leaf->next = right;
+
+    split.separator = right->keys[0];
+    split.right = right;
+    return true;
+}
+
+/**
+ * Links childSplit's right half in after inner's child i. A full inner
+ * node splits around its middle key, which moves up as split's separator.
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+void BTree<Key, Value, B, Compare>::insertIntoInner(Inner *inner, std::size_t i, const Split &childSplit, Split &split)
+{
+    if (inner->count < B)
+    {
+        std::move_backward(inner->keys + i, inner->keys + inner->count, inner->keys + inner->count + 1);
+        std::move_backward(inner->children + i + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+        inner->keys[i] = childSplit.separator;
+        inner->children[i + 1] = childSplit.right;
+        inner->count++;
+        return;
+    }
+
+    // @summary Lay out the B + 1 keys and B + 2 children, then deal them out around the middle key
+    Key keys[B + 1];
+    NodeBase *children[B + 2];
+    for (std::size_t j = 0, src = 0; j <= B; j++)
+        keys[j] = (j == i) ? childSplit.separator : std::move(inner->keys[src++]);
+    for (std::size_t j = 0, src = 0; j <= B + 1; j++)
+        children[j] = (j == i + 1) ? childSplit.right : inner->children[src++];
+
+    const std::size_t leftCount = (B + 1) / 2;
+    Inner *right = new Inner();
+    std::move(keys, keys + leftCount, inner->keys);
+    std::copy(children, children + leftCount + 1, inner->children);
+    inner->count = leftCount;
+    std::move(keys + leftCount + 1, keys + B + 1, right->keys);
+    std::copy(children + leftCount + 1, children + B + 2, right->children);
+    right->count = B - leftCount;
+
+    split.separator = std::move(keys[leftCount]);
+    split.right = right;
+}
+
+/**
+ * Removes key from the tree, if it is there. Nodes left less than half
+ * full borrow from a sibling or merge with it; an emptied root goes away.
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+void BTree<Key, Value, B, Compare>::remove(const Key &key)
+{
+    if (root_ == NULL || !removeFrom(root_, key))
+        return;
+    size_--;
+
+    if (!root_->leaf && root_->count == 0)
+    {
+        Inner *old = static_cast<Inner *>(root_);
+        root_ = old->children[0];
+        delete old;
+        height_--;
+    }
+    else if (root_->leaf && root_->count == 0)
+    {
+        delete static_cast<Leaf *>(root_);
+        root_ = first_ = last_ = NULL;
+        height_ = 0;
+    }
+}
+
+/**
+ * Removes key from the subtree at n and returns whether it was there,
+ * fixing up any child that fell below half full on the way back.
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+bool BTree<Key, Value, B, Compare>::removeFrom(NodeBase *n, const Key &key)
+{
+    if (n->leaf)
+    {
+        Leaf *leaf = static_cast<Leaf *>(n);
+        std::size_t i = keyIndex(leaf, key, false);
+        if (i == leaf->count || comp_(key, leaf->keys[i]))
+            return false;
+        std::move(leaf->keys + i + 1, leaf->keys + leaf->count, leaf->keys + i);
+        std::move(leaf->values + i + 1, leaf->values + leaf->count, leaf->values + i);
+        leaf->count--;
+
+        // @summary Don't let a vacated slot keep the removed value alive
+        leaf->values[leaf->count] = Value();
+        return true;
+    }
+
+    Inner *inner = static_cast<Inner *>(n);
+    std::size_t i = keyIndex(inner, key, true);
+    if (!removeFrom(inner->children[i], key))
+        return false;
+    if (inner->children[i]->count < MIN_KEYS)
+        fixUnderflow(inner, i);
+    return true;
+}
+
+/**
+ * Refills parent's child i, which is one below half full: from a sibling
+ * that can spare a key if there is one, otherwise by merging with a sibling
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+void BTree<Key, Value, B, Compare>::fixUnderflow(Inner *parent, std::size_t i)
+{
+    if (i > 0 && parent->children[i - 1]->count > MIN_KEYS)
+        borrowFromLeft(parent, i);
+    else if (i < parent->count && parent->children[i + 1]->count > MIN_KEYS)
+        borrowFromRight(parent, i);
+    else if (i > 0)
+        mergeChildren(parent, i - 1);
+    else
+        mergeChildren(parent, i);
+}
+
+/**
+ * Moves the last item (or child) of child i - 1 to the front of child i
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+void BTree<Key, Value, B, Compare>::borrowFromLeft(Inner *parent, std::size_t i)
+{
+    NodeBase *c = parent->children[i];
+    NodeBase *l = parent->children[i - 1];
+    std::move_backward(c->keys, c->keys + c->count, c->keys + c->count + 1);
+    if (c->leaf)
+    {
+        Leaf *cl = static_cast<Leaf *>(c);
+        Leaf *ll = static_cast<Leaf *>(l);
+        std::move_backward(cl->values, cl->values + cl->count, cl->values + cl->count + 1);
+        cl->keys[0] = std::move(ll->keys[ll->count - 1]);
+        cl->values[0] = std::move(ll->values[ll->count - 1]);
+        ll->values[ll->count - 1] = Value();
+        parent->keys[i - 1] = cl->keys[0];
+    }
+    else
+    {
+        // @summary Rotate through the parent: its separator comes down, l's last key goes up
+        Inner *ci = static_cast<Inner *>(c);
+        Inner *li = static_cast<Inner *>(l);
+        std::move_backward(ci->children, ci->children + ci->count + 1, ci->children + ci->count + 2);
+        ci->keys[0] = std::move(parent->keys[i - 1]);
+        ci->children[0] = li->children[li->count];
+        parent->keys[i - 1] = std::move(li->keys[li->count - 1]);
+    }
+    c->count++;
+    l->count--;
+}
+
+/**
+ * Moves the first item (or child) of child i + 1 to the back of child i
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+void BTree<Key, Value, B, Compare>::borrowFromRight(Inner *parent, std::size_t i)
+{
+    NodeBase *c = parent->children[i];
+    NodeBase *r = parent->children[i + 1];
+    if (c->leaf)
+    {
+        Leaf *cl = static_cast<Leaf *>(c);
+        Leaf *rl = static_cast<Leaf *>(r);
+        cl->keys[cl->count] = std::move(rl->keys[0]);
+        cl->values[cl->count] = std::move(rl->values[0]);
+        std::move(rl->keys + 1, rl->keys + rl->count, rl->keys);
+        std::move(rl->values + 1, rl->values + rl->count, rl->values);
+        rl->values[rl->count - 1] = Value();
+        parent->keys[i] = rl->keys[0];
+    }
+    else
+    {
+        Inner *ci = static_cast<Inner *>(c);
+        Inner *ri = static_cast<Inner *>(r);
+        ci->keys[ci->count] = std::move(parent->keys[i]);
+        ci->children[ci->count + 1] = ri->children[0];
+        parent->keys[i] = std::move(ri->keys[0]);
+        std::move(ri->keys + 1, ri->keys + ri->count, ri->keys);
+        std::move(ri->children + 1, ri->children + ri->count + 1, ri->children);
+    }
+    c->count++;
+    r->count--;
+}
+
+/**
+ * Merges parent's children i and i + 1 into child i and drops the
+ * separator between them from parent
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+void BTree<Key, Value, B, Compare>::mergeChildren(Inner *parent, std::size_t i)
+{
+    NodeBase *l = parent->children[i];
+    NodeBase *r = parent->children[i + 1];
+    if (l->leaf)
+    {
+        Leaf *ll = static_cast<Leaf *>(l);
+        Leaf *rl = static_cast<Leaf *>(r);
+        std::move(rl->keys, rl->keys + rl->count, ll->keys + ll->count);
+        std::move(rl->values, rl->values + rl->count, ll->values + ll->count);
+        ll->count += rl->count;
+        ll->next = rl->next;
+        if (rl->next != NULL)
+            rl->next->prev = ll;
+        else
+            last_ = ll;
+        delete rl;
+    }
+    else
+    {
+        // @summary The separator comes down between the two halves' keys
+        Inner *li = static_cast<Inner *>(l);
+        Inner *ri = static_cast<Inner *>(r);
+        li->keys[li->count] = std::move(parent->keys[i]);
+        std::move(ri->keys, ri->keys + ri->count, li->keys + li->count + 1);
+        std::copy(ri->children, ri->children + ri->count + 1, li->children + li->count + 1);
+        li->count += ri->count + 1;
+        delete ri;
+    }
+
+    std::move(parent->keys + i + 1, parent->keys + parent->count, parent->keys + i);
+    std::move(parent->children + i + 2, parent->children + parent->count + 1, parent->children + i + 1);
+    parent->count--;
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+void BTree<Key, Value, B, Compare>::clear()
+{
+    destroySubtree(root_);
+    root_ = first_ = last_ = NULL;
+    size_ = 0;
+    height_ = 0;
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+void BTree<Key, Value, B, Compare>::destroySubtree(NodeBase *n)
+{
+    if (n == NULL)
+        return;
+    if (n->leaf)
+    {
+        delete static_cast<Leaf *>(n);
+        return;
+    }
+    Inner *inner = static_cast<Inner *>(n);
+    for (std::size_t i = 0; i <= inner->count; i++)
+        destroySubtree(inner->children[i]);
+    delete inner;
+}
+
+/**
+ * Checks the B-tree invariants: all leaves at the same depth, every node
+ * but the root at least half full, keys sorted and within the bounds their
+ * separators set, and the leaf chain covering every item.
+ */
+template <class Key, class Value, std::size_t B, class Compare>
+bool BTree<Key, Value, B, Compare>::isBalanced() const
+{
+    if (root_ == NULL)
+        return size_ == 0 && first_ == NULL && height_ == 0;
+    int leafDepth = -1;
+    std::size_t items = 0;
+    if (!checkNode(root_, 1, leafDepth, NULL, NULL, items) || leafDepth != height_ || items != size_)
+        return false;
+
+    std::size_t chained = 0;
+    for (Leaf *leaf = first_; leaf != NULL; leaf = leaf->next)
+    {
+        if (leaf->next == NULL ? leaf != last_ : leaf->next->prev != leaf)
+            return false;
+        chained += leaf->count;
+    }
+    return chained == size_;
+}
+
+template <class Key, class Value, std::size_t B, class Compare>
+bool BTree<Key, Value, B, Compare>::checkNode(const NodeBase *n, int depth, int &leafDepth, const Key *lo, const Key *hi,
+                                              std::size_t &items) const
+{
+    if (n->count > B || (n != root_ && n->count < MIN_KEYS))
+        return false;
+    for (std::size_t i = 0; i < n->count; i++)
+    {
+        if (i > 0 && !comp_(n->keys[i - 1], n->keys[i]))
+            return false;
+        if ((lo != NULL && comp_(n->keys[i], *lo)) || (hi != NULL && !comp_(n->keys[i], *hi)))
+            return false;
+    }
+    if (n->leaf)
+    {
+        if (leafDepth == -1)
+            leafDepth = depth;
+        items += n->count;
+        return leafDepth == depth;
+    }
+
+    // @summary Child i holds keys in [keys[i - 1], keys[i])
+    const Inner *inner = static_cast<const Inner *>(n);
+    for (std::size_t i = 0; i <= inner->count; i++)
+    {
+        const Key *childLo = (i == 0) ? lo : &inner->keys[i - 1];
+        const Key *childHi = (i == inner->count) ? hi : &inner->keys[i];
+        if (!checkNode(inner->children[i], depth + 1, leafDepth, childLo, childHi, items))
+            return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,718 @@
+#ifndef COMPACT_AVLBST_H
+#define COMPACT_AVLBST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * An AVL tree for very large maps, with nodes stored in one contiguous array
+ * and linked by 32-bit indices instead of pointers.
+ *
+ * A node is its key, its value and three uint32_t links (left, right and
+ * parent), with no vtable pointer, subtree size or separate balance field:
+ * the top bit of the left link is set when the left subtree is taller, and
+ * the top bit of the right link when the right one is. For int keys and
+ * values that is 20 bytes a node, against 48 for an AVLNode. Index 0 means
+ * "no node", so the tree holds up to 2^31 - 1 items. Removed nodes go on a
+ * free list threaded through their left links and are reused first.
+ *
+ * Since the array may grow, an insert invalidates references to values
+ * (as in std::vector), but not iterators, which hold an index. As in
+ * BTree, an iterator yields a std::pair<const Key &, Value &> of
+ * references. Value must be default constructible, so that a freed node
+ * can let go of its value.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class CompactAVLTree
+{
+public:
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key &, Value &> reference;
+
+        // Holds the pair of references that operator-> points into
+        class pointer
+        {
+        public:
+            explicit pointer(const reference &ref) : ref_(ref) {}
+            const reference *operator->() const { return &ref_; }
+
+        private:
+            reference ref_;
+        };
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator &rhs) const;
+        bool operator!=(const iterator &rhs) const;
+
+        iterator &operator++();
+        iterator operator++(int);
+        iterator &operator--();
+        iterator operator--(int);
+
+    private:
+        friend class CompactAVLTree<Key, Value, Compare>;
+        iterator(uint32_t index, const CompactAVLTree<Key, Value, Compare> *tree);
+        uint32_t index_;
+        const CompactAVLTree<Key, Value, Compare> *tree_;
+    };
+
+    CompactAVLTree();
+    explicit CompactAVLTree(const Compare &comp);
+
+    void insert(const std::pair<const Key, Value> &keyValuePair);
+    void remove(const Key &key);
+    void clear();
+    void reserve(std::size_t n);
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key &key) const;
+    Value &operator[](const Key &key);
+    Value const &operator[](const Key &key) const;
+
+    bool isBalanced() const;
+    bool empty() const;
+    std::size_t size() const;
+    std::size_t memoryUsage() const;
+
+private:
+    static const uint32_t NIL = 0;
+    static const uint32_t TALLER = 0x80000000u;    // top bit of a child link
+    static const uint32_t INDEX_MASK = 0x7fffffffu; // the rest is the index
+
+    struct Node
+    {
+        Node(const Key &k, const Value &v, uint32_t p) : key(k), value(v), left(NIL), right(NIL), parent(p) {}
+
+        Key key;
+        Value value;
+        uint32_t left;  // index, plus TALLER if the left subtree is taller
+        uint32_t right; // index, plus TALLER if the right subtree is taller
+        uint32_t parent;
+    };
+
+    Node &node(uint32_t i);
+    const Node &node(uint32_t i) const;
+    uint32_t left(uint32_t i) const;
+    uint32_t right(uint32_t i) const;
+    uint32_t parent(uint32_t i) const;
+    void setLeft(uint32_t i, uint32_t child);
+    void setRight(uint32_t i, uint32_t child);
+    int balance(uint32_t i) const;
+    void setBalance(uint32_t i, int b);
+
+    uint32_t internalFind(const Key &key) const;
+    uint32_t successor(uint32_t i) const;
+    uint32_t predecessor(uint32_t i) const;
+    uint32_t allocateNode(const std::pair<const Key, Value> &keyValuePair, uint32_t parent);
+    void freeNode(uint32_t i);
+    void replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild);
+    void rotateLeft(uint32_t i);
+    void rotateRight(uint32_t i);
+    uint32_t fixLeftHeavy(uint32_t i);
+    uint32_t fixRightHeavy(uint32_t i);
+    int checkedHeight(uint32_t i, uint32_t parent, bool &balanced) const;
+
+    std::vector<Node> nodes_; // node i lives at nodes_[i - 1]
+    uint32_t root_;
+    uint32_t freeList_;
+    std::size_t size_;
+    Compare comp_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the iterator class.
+  -----------------------------------------------
+*/
+
+template <class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator() : index_(NIL), tree_(NULL)
+{
+}
+
+template <class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::iterator::iterator(uint32_t index, const CompactAVLTree<Key, Value, Compare> *tree)
+    : index_(index), tree_(tree)
+{
+}
+
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator::reference CompactAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    Node &n = const_cast<CompactAVLTree<Key, Value, Compare> *>(tree_)->node(index_);
+    return reference(n.key, n.value);
+}
+
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator::pointer CompactAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return pointer(**this);
+}
+
+template <class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator==(const iterator &rhs) const
+{
+    return index_ == rhs.index_;
+}
+
+template <class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator &rhs) const
+{
+    return index_ != rhs.index_;
+}
+
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator &CompactAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    index_ = tree_->successor(index_);
+    return *this;
+}
+
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/**
+ * Steps back to the previous item; --end() is the last item
+ */
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator &CompactAVLTree<Key, Value, Compare>::iterator::operator--()
+{
+    if (index_ != NIL)
+        index_ = tree_->predecessor(index_);
+    else
+    {
+        index_ = tree_->root_;
+        while (index_ != NIL && tree_->right(index_) != NIL)
+            index_ = tree_->right(index_);
+    }
+    return *this;
+}
+
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  -----------------------------------------------
+  Begin implementations for the CompactAVLTree class.
+  -----------------------------------------------
+*/
+
+template <class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::CompactAVLTree() : root_(NIL), freeList_(NIL), size_(0), comp_()
+{
+}
+
+template <class Key, class Value, class Compare>
+CompactAVLTree<Key, Value, Compare>::CompactAVLTree(const Compare &comp) : root_(NIL), freeList_(NIL), size_(0), comp_(comp)
+{
+}
+
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::Node &CompactAVLTree<Key, Value, Compare>::node(uint32_t i)
+{
+    return nodes_[i - 1];
+}
+
+template <class Key, class Value, class Compare>
+const typename CompactAVLTree<Key, Value, Compare>::Node &CompactAVLTree<Key, Value, Compare>::node(uint32_t i) const
+{
+    return nodes_[i - 1];
+}
+
+template <class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::left(uint32_t i) const
+{
+    return node(i).left & INDEX_MASK;
+}
+
+template <class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::right(uint32_t i) const
+{
+    return node(i).right & INDEX_MASK;
+}
+
+template <class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::parent(uint32_t i) const
+{
+    return node(i).parent;
+}
+
+/**
+ * Points i's left link at child (which may be NIL), keeping i's balance bit
+ */
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setLeft(uint32_t i, uint32_t child)
+{
+    node(i).left = (node(i).left & TALLER) | child;
+    if (child != NIL)
+        node(child).parent = i;
+}
+
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setRight(uint32_t i, uint32_t child)
+{
+    node(i).right = (node(i).right & TALLER) | child;
+    if (child != NIL)
+        node(child).parent = i;
+}
+
+/**
+ * Returns height(right) - height(left), read off the two TALLER bits
+ */
+template <class Key, class Value, class Compare>
+int CompactAVLTree<Key, Value, Compare>::balance(uint32_t i) const
+{
+    return (int)(node(i).right >> 31) - (int)(node(i).left >> 31);
+}
+
+/**
+ * @precondition b is -1, 0 or 1
+ */
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::setBalance(uint32_t i, int b)
+{
+    Node &n = node(i);
+    n.left = (n.left & INDEX_MASK) | (b < 0 ? TALLER : 0);
+    n.right = (n.right & INDEX_MASK) | (b > 0 ? TALLER : 0);
+}
+
+template <class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+template <class Key, class Value, class Compare>
+std::size_t CompactAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+/**
+ * Returns the bytes held by the node array, including free and spare slots
+ */
+template <class Key, class Value, class Compare>
+std::size_t CompactAVLTree<Key, Value, Compare>::memoryUsage() const
+{
+    return nodes_.capacity() * sizeof(Node);
+}
+
+/**
+ * Makes room for n nodes in total, so that building a tree of known size
+ * does not reallocate the array
+ */
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::reserve(std::size_t n)
+{
+    nodes_.reserve(n);
+}
+
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::clear()
+{
+    nodes_.clear();
+    root_ = NIL;
+    freeList_ = NIL;
+    size_ = 0;
+}
+
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::begin() const
+{
+    uint32_t i = root_;
+    while (i != NIL && left(i) != NIL)
+        i = left(i);
+    return iterator(i, this);
+}
+
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator(NIL, this);
+}
+
+template <class Key, class Value, class Compare>
+typename CompactAVLTree<Key, Value, Compare>::iterator CompactAVLTree<Key, Value, Compare>::find(const Key &key) const
+{
+    return iterator(internalFind(key), this);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template <class Key, class Value, class Compare>
+Value &CompactAVLTree<Key, Value, Compare>::operator[](const Key &key)
+{
+    uint32_t i = internalFind(key);
+    if (i == NIL)
+        throw std::out_of_range("Invalid key");
+    return node(i).value;
+}
+
+template <class Key, class Value, class Compare>
+Value const &CompactAVLTree<Key, Value, Compare>::operator[](const Key &key) const
+{
+    uint32_t i = internalFind(key);
+    if (i == NIL)
+        throw std::out_of_range("Invalid key");
+    return node(i).value;
+}
+
+template <class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::internalFind(const Key &key) const
+{
+    uint32_t i = root_;
+    while (i != NIL)
+    {
+        const Node &n = node(i);
+        if (comp_(key, n.key))
+            i = n.left & INDEX_MASK;
+        else if (comp_(n.key, key))
+            i = n.right & INDEX_MASK;
+        else
+            return i;
+    }
+    return NIL;
+}
+
+template <class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::successor(uint32_t i) const
+{
+    if (right(i) != NIL)
+    {
+        i = right(i);
+        while (left(i) != NIL)
+            i = left(i);
+        return i;
+    }
+    uint32_t p = parent(i);
+    while (p != NIL && right(p) == i)
+    {
+        i = p;
+        p = parent(p);
+    }
+    return p;
+}
+
+template <class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::predecessor(uint32_t i) const
+{
+    if (left(i) != NIL)
+    {
+        i = left(i);
+        while (right(i) != NIL)
+            i = right(i);
+        return i;
+    }
+    uint32_t p = parent(i);
+    while (p != NIL && left(p) == i)
+    {
+        i = p;
+        p = parent(p);
+    }
+    return p;
+}
+
+/**
+ * Returns the index of a new balanced leaf holding keyValuePair, taken from
+ * the free list if it has one
+ */
+template <class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::allocateNode(const std::pair<const Key, Value> &keyValuePair, uint32_t parent)
+{
+    if (freeList_ != NIL)
+    {
+        uint32_t i = freeList_;
+        Node &n = node(i);
+        freeList_ = n.left;
+        n.key = keyValuePair.first;
+        n.value = keyValuePair.second;
+        n.left = n.right = NIL;
+        n.parent = parent;
+        return i;
+    }
+    if (nodes_.size() >= INDEX_MASK)
+        throw std::length_error("CompactAVLTree is full");
+    nodes_.push_back(Node(keyValuePair.first, keyValuePair.second, parent));
+    return (uint32_t)nodes_.size();
+}
+
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::freeNode(uint32_t i)
+{
+    Node &n = node(i);
+    n.value = Value();
+    n.left = freeList_;
+    n.right = n.parent = NIL;
+    freeList_ = i;
+}
+
+/**
+ * Makes newChild take oldChild's place under parent, or at the root if
+ * parent is NIL
+ */
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::replaceChild(uint32_t parent, uint32_t oldChild, uint32_t newChild)
+{
+    if (parent == NIL)
+    {
+        root_ = newChild;
+        if (newChild != NIL)
+            node(newChild).parent = NIL;
+    }
+    else if (left(parent) == oldChild)
+        setLeft(parent, newChild);
+    else
+        setRight(parent, newChild);
+}
+
+/**
+ * Moves i's right child up into i's place. Only relinks; the callers below
+ * set the balances, since a two-bit balance cannot hold the +-2 in between.
+ */
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::rotateLeft(uint32_t i)
+{
+    uint32_t r = right(i);
+    replaceChild(parent(i), i, r);
+    setRight(i, left(r));
+    setLeft(r, i);
+}
+
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::rotateRight(uint32_t i)
+{
+    uint32_t l = left(i);
+    replaceChild(parent(i), i, l);
+    setLeft(i, right(l));
+    setRight(l, i);
+}
+
+/**
+ * Rebalances i, whose left subtree is two levels taller than its right,
+ * with a single or double rotation. Returns the subtree's new root, which
+ * is balanced exactly when the subtree got shorter.
+ */
+template <class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::fixLeftHeavy(uint32_t i)
+{
+    uint32_t c = left(i);
+    int cb = balance(c);
+    if (cb <= 0)
+    {
+        // @condition A balanced child only happens on remove, and keeps the height
+        rotateRight(i);
+        setBalance(i, cb == 0 ? -1 : 0);
+        setBalance(c, cb == 0 ? 1 : 0);
+        return c;
+    }
+    uint32_t g = right(c);
+    int gb = balance(g);
+    rotateLeft(c);
+    rotateRight(i);
+    setBalance(i, gb < 0 ? 1 : 0);
+    setBalance(c, gb > 0 ? -1 : 0);
+    setBalance(g, 0);
+    return g;
+}
+
+/**
+ * The mirror image of fixLeftHeavy
+ */
+template <class Key, class Value, class Compare>
+uint32_t CompactAVLTree<Key, Value, Compare>::fixRightHeavy(uint32_t i)
+{
+    uint32_t c = right(i);
+    int cb = balance(c);
+    if (cb >= 0)
+    {
+        rotateLeft(i);
+        setBalance(i, cb == 0 ? 1 : 0);
+        setBalance(c, cb == 0 ? -1 : 0);
+        return c;
+    }
+    uint32_t g = left(c);
+    int gb = balance(g);
+    rotateRight(c);
+    rotateLeft(i);
+    setBalance(i, gb > 0 ? -1 : 0);
+    setBalance(c, gb < 0 ? 1 : 0);
+    setBalance(g, 0);
+    return g;
+}
+
+/**
+ * Inserts keyValuePair, or overwrites the value if the key is already
+ * present, then retraces through the parent indices, rebalancing with
+ * fixLeftHeavy or fixRightHeavy
+ */
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    const Key &key = keyValuePair.first;
+    uint32_t p = NIL;
+    uint32_t i = root_;
+    bool goLeft = false;
+    while (i != NIL)
+    {
+        p = i;
+        if (comp_(key, node(i).key))
+            goLeft = true;
+        else if (comp_(node(i).key, key))
+            goLeft = false;
+        else
+        {
+            // @condition If key is the same, update value
+            node(i).value = keyValuePair.second;
+            return;
+        }
+        i = goLeft ? left(i) : right(i);
+    }
+
+    uint32_t n = allocateNode(keyValuePair, p);
+    size_++;
+    if (p == NIL)
+    {
+        root_ = n;
+        return;
+    }
+    if (goLeft)
+        setLeft(p, n);
+    else
+        setRight(p, n);
+
+    // @summary Walk up while the subtree below grew taller
+    uint32_t child = n;
+    while (p != NIL)
+    {
+        int diff = (left(p) == child) ? -1 : 1;
+        int b = balance(p) + diff;
+        if (b == 0)
+        {
+            setBalance(p, 0);
+            break;
+        }
+        if (b == diff)
+        {
+            setBalance(p, b);
+            child = p;
+            p = parent(p);
+            continue;
+        }
+        if (diff < 0)
+            fixLeftHeavy(p);
+        else
+            fixRightHeavy(p);
+        break;
+    }
+}
+
+/**
+ * Removes key if it is there. A node with two children takes over its
+ * predecessor's item and the predecessor's node is unlinked and put on
+ * the free list; then the tree retraces through the parent indices.
+ */
+template <class Key, class Value, class Compare>
+void CompactAVLTree<Key, Value, Compare>::remove(const Key &key)
+{
+    uint32_t n = internalFind(key);
+    if (n == NIL)
+        return;
+
+    // @condition 2 child case: move the predecessor's item up and remove its node instead
+    if (left(n) != NIL && right(n) != NIL)
+    {
+        uint32_t pred = predecessor(n);
+        node(n).key = std::move(node(pred).key);
+        node(n).value = std::move(node(pred).value);
+        n = pred;
+    }
+
+    uint32_t child = (left(n) != NIL) ? left(n) : right(n);
+    uint32_t p = parent(n);
+    bool shrankLeft = (p != NIL && left(p) == n);
+    replaceChild(p, n, child);
+    freeNode(n);
+    size_--;
+
+    // @summary Walk up while the subtree below got shorter
+    while (p != NIL)
+    {
+        int diff = shrankLeft ? 1 : -1;
+        int b = balance(p) + diff;
+        uint32_t gp = parent(p);
+        bool pIsLeft = (gp != NIL && left(gp) == p);
+
+        // @condition p was balanced, so its height did not change
+        if (b == diff)
+        {
+            setBalance(p, b);
+            break;
+        }
+        if (b == 0)
+            setBalance(p, 0);
+        else
+        {
+            uint32_t top = (diff > 0) ? fixRightHeavy(p) : fixLeftHeavy(p);
+            if (balance(top) != 0)
+                break;
+        }
+        p = gp;
+        shrankLeft = pIsLeft;
+    }
+}
+
+/**
+ * Checks every balance bit pair against the subtree heights, and every
+ * parent link
+ */
+template <class Key, class Value, class Compare>
+bool CompactAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    bool balanced = true;
+    checkedHeight(root_, NIL, balanced);
+    return balanced;
+}
+
+template <class Key, class Value, class Compare>
+int CompactAVLTree<Key, Value, Compare>::checkedHeight(uint32_t i, uint32_t parentIndex, bool &balanced) const
+{
+    if (i == NIL)
+        return 0;
+    if (parent(i) != parentIndex)
+        balanced = false;
+    int lh = checkedHeight(left(i), i, balanced);
+    int rh = checkedHeight(right(i), i, balanced);
+    if (balance(i) != rh - lh || rh - lh > 1 || lh - rh > 1)
+        balanced = false;
+    return std::max(lh, rh) + 1;
+}
+
+#endif
@@ -0,0 +1,634 @@
+#ifndef CONCURRENT_AVLBST_H
+#define CONCURRENT_AVLBST_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+ * A reader-writer spin lock in a single word, small enough for every node.
+ * The top bit is set while a writer holds the lock and the low bits count
+ * readers. A waiting writer sets the next bit, which keeps new readers out
+ * until it gets in. Waiting threads yield, so an oversubscribed machine
+ * still makes progress.
+ */
+class RWSpinLock
+{
+public:
+    RWSpinLock() : state_(0) {}
+
+    void lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+
+private:
+    static const uint32_t WRITER = 1u << 31;
+    static const uint32_t WRITER_WAITING = 1u << 30;
+
+    std::atomic<uint32_t> state_;
+};
+
+inline void RWSpinLock::lock()
+{
+    uint32_t s = state_.load(std::memory_order_relaxed);
+    while (true)
+    {
+        // @condition No readers and no writer: take it (clearing any waiting bit)
+        if ((s & ~WRITER_WAITING) == 0)
+        {
+            if (state_.compare_exchange_weak(s, WRITER, std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+            continue;
+        }
+        if ((s & WRITER_WAITING) == 0)
+            state_.fetch_or(WRITER_WAITING, std::memory_order_relaxed);
+        std::this_thread::yield();
+        s = state_.load(std::memory_order_relaxed);
+    }
+}
+
+inline void RWSpinLock::unlock()
+{
+    state_.fetch_and(~WRITER, std::memory_order_release);
+}
+
+inline void RWSpinLock::lock_shared()
+{
+    uint32_t s = state_.load(std::memory_order_relaxed);
+    while (true)
+    {
+        if ((s & (WRITER | WRITER_WAITING)) == 0)
+        {
+            if (state_.compare_exchange_weak(s, s + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+            continue;
+        }
+        std::this_thread::yield();
+        s = state_.load(std::memory_order_relaxed);
+    }
+}
+
+inline void RWSpinLock::unlock_shared()
+{
+    state_.fetch_sub(1, std::memory_order_release);
+}
+
+/**
+ * An AVL tree that many threads can use at once, with a lock in every node.
+ *
+ * Lookups descend hand over hand with shared locks, holding at most two at a
+ * time, so readers never block each other and only wait for a writer that is
+ * restructuring the very nodes they pass through.
+ *
+ * Writers also descend hand over hand, but with exclusive locks, and release
+ * everything above the last node whose subtree height cannot change. For an
+ * insert, that is a node with a nonzero balance: the retrace either stops
+ * there or rotates there. For a remove, it is a node that is balanced, or
+ * that leans away from the removal with a balanced sibling. Since a retrace
+ * never goes past such a node, and a rotation only relinks its parent, a
+ * writer ends up holding just the nodes it restructures. That is usually a
+ * handful near the leaves rather than the whole path from the root.
+ *
+ * Locks are only ever taken from parent to child, so there is no deadlock.
+ * A node is only freed while its parent is locked exclusively, so no other
+ * thread can be on it or on its way to it; that makes reclamation safe without
+ * epochs or hazard pointers.
+ *
+ * Unlike AVLTree this keeps no parent links, subtree sizes or iterators.
+ * Lookups copy the value out, since a reference could outlive the lock.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class ConcurrentAVLTree
+{
+public:
+    ConcurrentAVLTree();
+    explicit ConcurrentAVLTree(const Compare &comp);
+    ~ConcurrentAVLTree();
+
+    // Thread-safe operations
+    bool insert(const std::pair<const Key, Value> &keyValuePair);
+    bool remove(const Key &key);
+    bool find(const Key &key, Value &value) const;
+    bool contains(const Key &key) const;
+    std::size_t size() const;
+    bool empty() const;
+
+    // Only safe while no other thread uses the tree
+    void clear();
+    bool isBalanced() const;
+
+private:
+    // A tree owns its nodes and locks, so it cannot be copied
+    ConcurrentAVLTree(const ConcurrentAVLTree &);
+    ConcurrentAVLTree &operator=(const ConcurrentAVLTree &);
+
+    struct Node
+    {
+        Node(const Key &k, const Value &v) : key(k), value(v), left(nullptr), right(nullptr), balance(0) {}
+
+        Key key;
+        Value value;
+        Node *left;
+        Node *right;
+        int8_t balance; // height(right) - height(left)
+        RWSpinLock lock;
+    };
+
+    /**
+     * The exclusively locked part of a writer's path, each node the parent
+     * of the next. If holdsRoot is set, rootLock_ is held and nodes[0] is
+     * the root; otherwise nodes[0] is only there to be relinked.
+     */
+    struct LockedPath
+    {
+        std::vector<Node *> nodes;
+        bool holdsRoot;
+    };
+
+    template <typename F>
+    bool visit(const Key &key, F &&f) const;
+    void releaseAbove(LockedPath &path, std::size_t keep, const Node *pinned);
+    void releaseAll(LockedPath &path);
+    Node *&linkTo(LockedPath &path, std::size_t i);
+    bool removeKeepsHeight(const Node *c, const Key &key, const Node *target) const;
+    static Node *rotateRight(Node *n);
+    static Node *rotateLeft(Node *n);
+    static void clearSubtree(Node *n);
+    static int checkedHeight(const Node *n, bool &balanced);
+
+    Node *root_;
+    mutable RWSpinLock rootLock_; // guards root_ itself
+    std::atomic<std::size_t> size_;
+    Compare comp_;
+};
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  ---------------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree() : root_(nullptr), size_(0), comp_()
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::ConcurrentAVLTree(const Compare &comp) : root_(nullptr), size_(0), comp_(comp)
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+ConcurrentAVLTree<Key, Value, Compare>::~ConcurrentAVLTree()
+{
+    clear();
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t ConcurrentAVLTree<Key, Value, Compare>::size() const
+{
+    return size_.load(std::memory_order_relaxed);
+}
+
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::empty() const
+{
+    return size() == 0;
+}
+
+/**
+ * Copies the value for key into value and returns true, or returns false
+ * if key is not in the tree.
+ */
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::find(const Key &key, Value &value) const
+{
+    return visit(key, [&value](const Value &v)
+                 { value = v; });
+}
+
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::contains(const Key &key) const
+{
+    return visit(key, [](const Value &) {});
+}
+
+/**
+ * Looks key up and, if it is there, calls f on its value while the node is
+ * still locked. Returns whether key was found.
+ */
+template <typename Key, typename Value, typename Compare>
+template <typename F>
+bool ConcurrentAVLTree<Key, Value, Compare>::visit(const Key &key, F &&f) const
+{
+    rootLock_.lock_shared();
+    Node *n = root_;
+    if (n != nullptr)
+        n->lock.lock_shared();
+    rootLock_.unlock_shared();
+
+    // @summary Hand over hand: lock the child before letting go of its parent
+    while (n != nullptr)
+    {
+        Node *c;
+        if (comp_(key, n->key))
+            c = n->left;
+        else if (comp_(n->key, key))
+            c = n->right;
+        else
+        {
+            f(n->value);
+            n->lock.unlock_shared();
+            return true;
+        }
+        if (c != nullptr)
+            c->lock.lock_shared();
+        n->lock.unlock_shared();
+        n = c;
+    }
+    return false;
+}
+
+/**
+ * Inserts keyValuePair and returns true, or, if the key is already present,
+ * overwrites its value and returns false.
+ */
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    const Key &key = keyValuePair.first;
+    LockedPath path;
+    path.holdsRoot = true;
+    rootLock_.lock();
+    if (root_ == nullptr)
+    {
+        root_ = new Node(key, keyValuePair.second);
+        size_.fetch_add(1, std::memory_order_relaxed);
+        rootLock_.unlock();
+        return true;
+    }
+    root_->lock.lock();
+    path.nodes.push_back(root_);
+
+    // @summary Descend with exclusive locks, dropping those the retrace cannot reach
+    Node *n = root_;
+    bool goLeft;
+    while (true)
+    {
+        if (comp_(key, n->key))
+            goLeft = true;
+        else if (comp_(n->key, key))
+            goLeft = false;
+        else
+        {
+            // @condition If key is the same, update value
+            n->value = keyValuePair.second;
+            releaseAll(path);
+            return false;
+        }
+        Node *c = goLeft ? n->left : n->right;
+        if (c == nullptr)
+            break;
+        c->lock.lock();
+
+        // @condition c's height cannot change, so only c's link in n might
+        if (c->balance != 0)
+            releaseAbove(path, path.nodes.size() - 1, nullptr);
+        path.nodes.push_back(c);
+        n = c;
+    }
+
+    Node *grown = new Node(key, keyValuePair.second);
+    if (goLeft)
+        n->left = grown;
+    else
+        n->right = grown;
+    size_.fetch_add(1, std::memory_order_relaxed);
+
+    // @summary Retrace up the locked path; every node a rotation moves is on it and held
+    for (std::size_t i = path.nodes.size(); i-- > 0;)
+    {
+        Node *p = path.nodes[i];
+        int8_t diff = (p->left == grown) ? -1 : 1;
+        p->balance += diff;
+        if (p->balance == 0)
+            break;
+        if (p->balance == diff)
+        {
+            grown = p;
+            continue;
+        }
+
+        // @summary p is off by two toward grown; the nodes involved are all on the path
+        Node *&link = linkTo(path, i);
+        if (diff < 0)
+        {
+            if (grown->balance > 0)
+                p->left = rotateLeft(grown);
+            link = rotateRight(p);
+        }
+        else
+        {
+            if (grown->balance < 0)
+                p->right = rotateRight(grown);
+            link = rotateLeft(p);
+        }
+        break;
+    }
+    releaseAll(path);
+    return true;
+}
+
+/**
+ * Removes key and returns true, or returns false if it is not in the tree.
+ * As in AVLTree, a node with two children takes over its predecessor's item
+ * and the predecessor's node is the one unlinked.
+ */
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::remove(const Key &key)
+{
+    LockedPath path;
+    path.holdsRoot = true;
+    rootLock_.lock();
+    if (root_ == nullptr)
+    {
+        rootLock_.unlock();
+        return false;
+    }
+    root_->lock.lock();
+    path.nodes.push_back(root_);
+
+    // @summary Descend to key, then on to its predecessor, keeping only what the retrace can reach
+    Node *n = root_;
+    Node *target = nullptr;
+    while (true)
+    {
+        bool goLeft;
+        if (target != nullptr)
+            goLeft = false;
+        else if (comp_(key, n->key))
+            goLeft = true;
+        else if (comp_(n->key, key))
+            goLeft = false;
+        else
+        {
+            target = n;
+            goLeft = true;
+        }
+        Node *c = goLeft ? n->left : n->right;
+        if (c == nullptr)
+            break;
+        c->lock.lock();
+        if (removeKeepsHeight(c, key, target))
+            releaseAbove(path, path.nodes.size() - 1, target);
+        path.nodes.push_back(c);
+        n = c;
+    }
+    if (target == nullptr)
+    {
+        releaseAll(path);
+        return false;
+    }
+
+    // @condition target may have been let go of the path above while staying locked
+    bool targetPinned = std::find(path.nodes.begin(), path.nodes.end(), target) == path.nodes.end();
+
+    // @condition 2 child case: n is the predecessor, whose item moves up into target
+    if (n != target)
+    {
+        target->key = std::move(n->key);
+        target->value = std::move(n->value);
+    }
+
+    // @summary Splice n out, promoting its only child (if any)
+    Node *child = (n->left != nullptr) ? n->left : n->right;
+    std::size_t i = path.nodes.size() - 1;
+    bool shrankLeft = (i > 0 && path.nodes[i - 1]->left == n);
+    linkTo(path, i) = child;
+    path.nodes.pop_back();
+    n->lock.unlock();
+    delete n;
+    size_.fetch_sub(1, std::memory_order_relaxed);
+
+    // @summary Retrace up the locked path; a sibling a rotation pulls in is locked when reached
+    while (i-- > 0)
+    {
+        Node *p = path.nodes[i];
+        bool pIsLeft = (i > 0 && path.nodes[i - 1]->left == p);
+        int8_t diff = shrankLeft ? 1 : -1;
+        p->balance += diff;
+
+        // @condition p was balanced, so its height did not change
+        if (p->balance == diff)
+            break;
+
+        // @condition p's taller side shrank; keep retracing
+        if (p->balance == 0)
+        {
+            shrankLeft = pIsLeft;
+            continue;
+        }
+
+        // @summary p is off by two toward its other child s, which is off the path and must be locked
+        Node *s = (diff > 0) ? p->right : p->left;
+        s->lock.lock();
+        int8_t sBalance = s->balance;
+        Node *inner = (diff > 0) ? s->left : s->right;
+        bool zigZag = (diff > 0) ? (sBalance < 0) : (sBalance > 0);
+        if (zigZag)
+            inner->lock.lock();
+        Node *&link = linkTo(path, i);
+        if (diff > 0)
+        {
+            if (zigZag)
+                p->right = rotateRight(s);
+            link = rotateLeft(p);
+        }
+        else
+        {
+            if (zigZag)
+                p->left = rotateLeft(s);
+            link = rotateRight(p);
+        }
+        if (zigZag)
+            inner->lock.unlock();
+        s->lock.unlock();
+
+        // @condition A single rotation about a balanced child keeps the height
+        if (sBalance == 0)
+            break;
+        shrankLeft = pIsLeft;
+    }
+
+    if (targetPinned)
+        target->lock.unlock();
+    releaseAll(path);
+    return true;
+}
+
+/**
+ * Decides, while c is locked, whether removing below c can change c's
+ * height. If c is not, no node above c's parent is touched by the retrace.
+ * target is the node holding key once it has been found, and NULL before.
+ */
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::removeKeepsHeight(const Node *c, const Key &key, const Node *target) const
+{
+    bool goLeft;
+    if (target != nullptr)
+        goLeft = false;
+    else if (comp_(key, c->key))
+        goLeft = true;
+    else if (comp_(c->key, key))
+        goLeft = false;
+    else
+        goLeft = true;
+
+    // @condition c itself is spliced out (or key is missing below c)
+    const Node *next = goLeft ? c->left : c->right;
+    if (next == nullptr)
+        return target == nullptr && (comp_(key, c->key) || comp_(c->key, key));
+
+    int8_t towards = goLeft ? -1 : 1;
+    if (c->balance == 0)
+        return true;
+    if (c->balance == towards)
+        return false;
+
+    // @summary c leans away: a rotation keeps its height only if the sibling is balanced.
+    // No other writer can change the sibling's balance without holding c, which we do.
+    const Node *sibling = goLeft ? c->right : c->left;
+    return sibling->balance == 0;
+}
+
+/**
+ * Unlocks path.nodes[0 .. keep) (except pinned, which stays locked but
+ * leaves the path) and rootLock_, leaving path.nodes[keep] as its top.
+ */
+template <typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::releaseAbove(LockedPath &path, std::size_t keep, const Node *pinned)
+{
+    if (path.holdsRoot)
+    {
+        rootLock_.unlock();
+        path.holdsRoot = false;
+    }
+    for (std::size_t i = 0; i < keep; i++)
+    {
+        if (path.nodes[i] != pinned)
+            path.nodes[i]->lock.unlock();
+    }
+    path.nodes.erase(path.nodes.begin(), path.nodes.begin() + keep);
+}
+
+template <typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::releaseAll(LockedPath &path)
+{
+    for (std::size_t i = path.nodes.size(); i-- > 0;)
+        path.nodes[i]->lock.unlock();
+    path.nodes.clear();
+    if (path.holdsRoot)
+    {
+        rootLock_.unlock();
+        path.holdsRoot = false;
+    }
+}
+
+/**
+ * Returns the link pointing at path.nodes[i]: a child pointer of the node
+ * before it, or root_ for the first node while rootLock_ is held.
+ */
+template <typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node *&
+ConcurrentAVLTree<Key, Value, Compare>::linkTo(LockedPath &path, std::size_t i)
+{
+    if (i == 0)
+        return root_;
+    Node *p = path.nodes[i - 1];
+    return (p->left == path.nodes[i]) ? p->left : p->right;
+}
+
+/**
+ * Rotates n's left child up and returns it. The caller holds both nodes'
+ * locks and points n's old link at the result.
+ */
+template <typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node *ConcurrentAVLTree<Key, Value, Compare>::rotateRight(Node *n)
+{
+    Node *l = n->left;
+    n->left = l->right;
+    l->right = n;
+    int nb = n->balance, lb = l->balance;
+    rightRotationBalances(nb, lb);
+    n->balance = nb;
+    l->balance = lb;
+    return l;
+}
+
+/**
+ * Rotates n's right child up and returns it.
+ */
+template <typename Key, typename Value, typename Compare>
+typename ConcurrentAVLTree<Key, Value, Compare>::Node *ConcurrentAVLTree<Key, Value, Compare>::rotateLeft(Node *n)
+{
+    Node *r = n->right;
+    n->right = r->left;
+    r->left = n;
+    int nb = n->balance, rb = r->balance;
+    leftRotationBalances(nb, rb);
+    n->balance = nb;
+    r->balance = rb;
+    return r;
+}
+
+template <typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::clear()
+{
+    clearSubtree(root_);
+    root_ = nullptr;
+    size_.store(0, std::memory_order_relaxed);
+}
+
+template <typename Key, typename Value, typename Compare>
+void ConcurrentAVLTree<Key, Value, Compare>::clearSubtree(Node *n)
+{
+    if (n != nullptr)
+    {
+        clearSubtree(n->left);
+        clearSubtree(n->right);
+        delete n;
+    }
+}
+
+/**
+ * Checks that every stored balance matches the subtree heights and is
+ * within [-1, 1].
+ */
+template <typename Key, typename Value, typename Compare>
+bool ConcurrentAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    bool balanced = true;
+    checkedHeight(root_, balanced);
+    return balanced;
+}
+
+template <typename Key, typename Value, typename Compare>
+int ConcurrentAVLTree<Key, Value, Compare>::checkedHeight(const Node *n, bool &balanced)
+{
+    if (n == nullptr)
+        return 0;
+    int lh = checkedHeight(n->left, balanced);
+    int rh = checkedHeight(n->right, balanced);
+    if (n->balance != rh - lh || rh - lh > 1 || lh - rh > 1)
+        balanced = false;
+    return std::max(lh, rh) + 1;
+}
+
+#endif
@@ -0,0 +1,315 @@
+#ifndef EYTZINGER_INDEX_H
+#define EYTZINGER_INDEX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <vector>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define EYTZINGER_AVX2 1
+#endif
+
+#ifdef EYTZINGER_AVX2
+/**
+ * Eight lower_bound searches at once on int keys in Eytzinger order
+ * (1-based, n keys), leaving each query's final index in ks. A lane whose
+ * index has run past n stops moving; the others keep gathering their next
+ * key. Compiled for AVX2 on its own, so the rest of the build needs no
+ * -mavx2; callers check the CPU first.
+ */
+__attribute__((target("avx2"))) inline void eytzingerDescend8(const int *keys, std::size_t n, int height,
+                                                              const int *queries, uint32_t *ks)
+{
+    __m256i q = _mm256_loadu_si256((const __m256i *)queries);
+    __m256i k = _mm256_set1_epi32(1);
+    __m256i limit = _mm256_set1_epi32((int)n);
+    __m256i one = _mm256_set1_epi32(1);
+    for (int level = 0; level < height; level++)
+    {
+        // @summary Lanes with k <= n are still descending; gather only for those
+        __m256i active = _mm256_xor_si256(_mm256_cmpgt_epi32(k, limit), _mm256_set1_epi32(-1));
+        __m256i key = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), keys, k, active, 4);
+        __m256i goRight = _mm256_and_si256(_mm256_cmpgt_epi32(q, key), one);
+        __m256i next = _mm256_add_epi32(_mm256_add_epi32(k, k), goRight);
+        k = _mm256_blendv_epi8(k, next, active);
+    }
+    _mm256_storeu_si256((__m256i *)ks, k);
+}
+
+inline bool eytzingerHasAvx2()
+{
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+}
+#endif
+
+/**
+ * A read-only search index over the items of a BinarySearchTree, AVLTree
+ * or BTree with arithmetic keys, laid out in Eytzinger (BFS) order: the
+ * children of slot k are slots 2k and 2k + 1, and slot 0 is unused.
+ *
+ * A search is a branchless loop, k = 2k + comp(keys[k], key), whose only
+ * dependency is the load. Each step also prefetches the cache line 2^4
+ * levels further down (for 4-byte keys), which holds all 16 descendants
+ * there, so the memory latency of later levels overlaps with this one.
+ * find_batch runs eight int searches per AVX2 gather when the CPU has it,
+ * and otherwise a group of interleaved scalar searches.
+ *
+ * Searches return slots, with end() (slot 0) for "not found"; keyAt and
+ * valueAt read an item. The index is a copy: after a batch of updates to
+ * the tree, refresh() rebuilds it in O(n). Compare must be the source
+ * tree's key_compare, which refresh() checks; only std::less<int> takes
+ * the AVX2 path.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class EytzingerIndex
+{
+    static_assert(std::is_arithmetic<Key>::value, "EytzingerIndex needs arithmetic keys");
+
+public:
+    EytzingerIndex();
+    template <typename Tree>
+    explicit EytzingerIndex(const Tree &tree);
+    ~EytzingerIndex();
+
+    template <typename Tree>
+    void refresh(const Tree &tree);
+
+    std::size_t find(const Key &key) const;
+    std::size_t lower_bound(const Key &key) const;
+    void find_batch(const Key *keys, std::size_t count, std::size_t *slots) const;
+    std::size_t end() const;
+
+    const Key &keyAt(std::size_t slot) const;
+    const Value &valueAt(std::size_t slot) const;
+    std::size_t size() const;
+    bool empty() const;
+
+private:
+    // The index owns an aligned array, so it cannot be copied
+    EytzingerIndex(const EytzingerIndex &);
+    EytzingerIndex &operator=(const EytzingerIndex &);
+
+    static const std::size_t CACHE_LINE = 64;
+    static const std::size_t KEYS_PER_LINE = CACHE_LINE / sizeof(Key) > 0 ? CACHE_LINE / sizeof(Key) : 1;
+
+    template <typename It>
+    void fill(It &it, std::size_t k);
+    void prefetchBelow(std::size_t k) const;
+    static std::size_t lowerBoundSlot(std::size_t k);
+
+    Key *keys_; // keys_[1 .. n]; keys_ itself starts a cache line
+    std::vector<Value> values_;
+    std::size_t size_;
+    int height_; // levels in the implicit tree
+    Compare comp_;
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the EytzingerIndex class.
+  ---------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+EytzingerIndex<Key, Value, Compare>::EytzingerIndex() : keys_(NULL), size_(0), height_(0), comp_()
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+template <typename Tree>
+EytzingerIndex<Key, Value, Compare>::EytzingerIndex(const Tree &tree) : keys_(NULL), size_(0), height_(0), comp_()
+{
+    refresh(tree);
+}
+
+template <typename Key, typename Value, typename Compare>
+EytzingerIndex<Key, Value, Compare>::~EytzingerIndex()
+{
+    ::operator delete(keys_, std::align_val_t(CACHE_LINE));
+}
+
+/**
+ * Rebuilds the index from the current items of tree, in O(n)
+ */
+template <typename Key, typename Value, typename Compare>
+template <typename Tree>
+void EytzingerIndex<Key, Value, Compare>::refresh(const Tree &tree)
+{
+    static_assert(std::is_same<typename Tree::key_compare, Compare>::value,
+                  "EytzingerIndex must search in the order of the tree it copies");
+    ::operator delete(keys_, std::align_val_t(CACHE_LINE));
+    keys_ = NULL;
+    size_ = tree.size();
+    height_ = 0;
+    while (((std::size_t)1 << height_) <= size_)
+        height_++;
+    keys_ = static_cast<Key *>(::operator new((size_ + 1) * sizeof(Key), std::align_val_t(CACHE_LINE)));
+    keys_[0] = Key();
+    values_.assign(size_ + 1, Value());
+
+    typename Tree::iterator it = tree.begin();
+    fill(it, 1);
+}
+
+/**
+ * Writes the items from it into the subtree at slot k, in order
+ */
+template <typename Key, typename Value, typename Compare>
+template <typename It>
+void EytzingerIndex<Key, Value, Compare>::fill(It &it, std::size_t k)
+{
+    if (k > size_)
+        return;
+    fill(it, 2 * k);
+    keys_[k] = it->first;
+    values_[k] = it->second;
+    ++it;
+    fill(it, 2 * k + 1);
+}
+
+/**
+ * Prefetches the line holding slot k's descendants log2(KEYS_PER_LINE)
+ * levels down. Past the end of the array this is a harmless no-op.
+ */
+template <typename Key, typename Value, typename Compare>
+void EytzingerIndex<Key, Value, Compare>::prefetchBelow(std::size_t k) const
+{
+#if defined(__GNUC__)
+    __builtin_prefetch(reinterpret_cast<const void *>(reinterpret_cast<uintptr_t>(keys_) + k * KEYS_PER_LINE * sizeof(Key)));
+#endif
+}
+
+/**
+ * Turns the index a search ran off the tree at into the last slot where it
+ * went left, i.e. the lower bound: strip the trailing right turns (1 bits)
+ * and that last left turn. Returns 0 if it never went left.
+ */
+template <typename Key, typename Value, typename Compare>
+std::size_t EytzingerIndex<Key, Value, Compare>::lowerBoundSlot(std::size_t k)
+{
+#if defined(__GNUC__)
+    return k >> __builtin_ffsll(~(unsigned long long)k);
+#else
+    while (k & 1)
+        k >>= 1;
+    return k >> 1;
+#endif
+}
+
+/**
+ * Returns the slot of the first key not less than key, or end()
+ */
+template <typename Key, typename Value, typename Compare>
+std::size_t EytzingerIndex<Key, Value, Compare>::lower_bound(const Key &key) const
+{
+    std::size_t k = 1;
+    while (k <= size_)
+    {
+        prefetchBelow(k);
+        k = 2 * k + comp_(keys_[k], key);
+    }
+    return lowerBoundSlot(k);
+}
+
+/**
+ * Returns the slot of key, or end() if it is not in the index
+ */
+template <typename Key, typename Value, typename Compare>
+std::size_t EytzingerIndex<Key, Value, Compare>::find(const Key &key) const
+{
+    std::size_t k = lower_bound(key);
+    return (k != 0 && !comp_(key, keys_[k])) ? k : 0;
+}
+
+/**
+ * Looks up count keys, storing each one's slot (or end()) in slots. Eight
+ * int keys in std::less order at a time go through one AVX2 gather per
+ * level; other keys run in groups of eight scalar searches advanced in
+ * lock step, so their cache misses overlap.
+ */
+template <typename Key, typename Value, typename Compare>
+void EytzingerIndex<Key, Value, Compare>::find_batch(const Key *keys, std::size_t count, std::size_t *slots) const
+{
+    const std::size_t GROUP = 8;
+    std::size_t i = 0;
+#ifdef EYTZINGER_AVX2
+    if constexpr (std::is_same<Key, int>::value && std::is_same<Compare, std::less<int> >::value)
+    {
+        if (eytzingerHasAvx2() && size_ < (std::size_t)1 << 30)
+        {
+            uint32_t ks[GROUP];
+            for (; i + GROUP <= count; i += GROUP)
+            {
+                eytzingerDescend8(keys_, size_, height_, keys + i, ks);
+                for (std::size_t j = 0; j < GROUP; j++)
+                {
+                    std::size_t k = lowerBoundSlot(ks[j]);
+                    slots[i + j] = (k != 0 && !comp_(keys[i + j], keys_[k])) ? k : 0;
+                }
+            }
+        }
+    }
+#endif
+    for (; i + GROUP <= count; i += GROUP)
+    {
+        std::size_t ks[GROUP];
+        for (std::size_t j = 0; j < GROUP; j++)
+            ks[j] = 1;
+        for (int level = 0; level < height_; level++)
+        {
+            for (std::size_t j = 0; j < GROUP; j++)
+            {
+                // @condition Searches on the shorter paths of the last level stop early
+                if (ks[j] <= size_)
+                {
+                    prefetchBelow(ks[j]);
+                    ks[j] = 2 * ks[j] + comp_(keys_[ks[j]], keys[i + j]);
+                }
+            }
+        }
+        for (std::size_t j = 0; j < GROUP; j++)
+        {
+            std::size_t k = lowerBoundSlot(ks[j]);
+            slots[i + j] = (k != 0 && !comp_(keys[i + j], keys_[k])) ? k : 0;
+        }
+    }
+    for (; i < count; i++)
+        slots[i] = find(keys[i]);
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t EytzingerIndex<Key, Value, Compare>::end() const
+{
+    return 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+const Key &EytzingerIndex<Key, Value, Compare>::keyAt(std::size_t slot) const
+{
+    return keys_[slot];
+}
+
+template <typename Key, typename Value, typename Compare>
+const Value &EytzingerIndex<Key, Value, Compare>::valueAt(std::size_t slot) const
+{
+    return values_[slot];
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t EytzingerIndex<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool EytzingerIndex<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+#endif
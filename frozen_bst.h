@@ -0,0 +1,276 @@
+#ifndef FROZEN_BST_H
+#define FROZEN_BST_H
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+/**
+ * A read-only search tree compiled from a BinarySearchTree or AVLTree by
+ * freeze(), for phases that do nothing but lookups.
+ *
+ * The keys are laid out as a perfectly balanced tree with implicit children
+ * in van Emde Boas order: the top half of the levels is stored first and
+ * each subtree hanging off it follows as one contiguous block, recursively.
+ * Whatever the cache line or page size, a search then touches only
+ * O(log_B n) blocks, instead of one cache miss per level for heap nodes.
+ * Slots beyond the last key in order hold copies of the largest key, so
+ * every search takes exactly height() steps.
+ *
+ * The items themselves sit in a separate sorted array. A search only reads
+ * the dense key layout and ends with the item's in-order rank, and
+ * iterators are plain array iterators, so iterating and range queries cost
+ * no more than walking a vector.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class FrozenTree
+{
+public:
+    typedef typename std::vector<std::pair<const Key, Value> >::const_iterator iterator;
+    typedef iterator const_iterator;
+
+    FrozenTree();
+    // [first, last) must be sorted by comp, without duplicate keys
+    template <typename InputIt>
+    FrozenTree(InputIt first, InputIt last, const Compare &comp = Compare());
+
+    iterator begin() const;
+    iterator end() const;
+    std::size_t size() const;
+    bool empty() const;
+    int height() const;
+
+    iterator find(const Key &key) const;
+    iterator lower_bound(const Key &key) const;
+    iterator upper_bound(const Key &key) const;
+    std::pair<iterator, iterator> equal_range(const Key &key) const;
+    std::size_t count_range(const Key &lo, const Key &hi) const;
+
+private:
+    static const int MAX_HEIGHT = 64;
+
+    void computeLevels(int depth, int height);
+    void place(std::size_t i, int depth, std::size_t *pos, std::size_t &rank);
+    std::size_t position(std::size_t i, int depth, const std::size_t *pos) const;
+    template <typename Before>
+    std::size_t firstNotBefore(Before before) const;
+
+    std::vector<std::pair<const Key, Value> > items_; // sorted
+    std::vector<Key> layout_;                         // keys in van Emde Boas order
+    int height_;
+
+    // Per depth d > 0, the split of the vEB recursion in which depth d
+    // becomes the root of a bottom tree (see position())
+    std::vector<std::size_t> topSize_;
+    std::vector<std::size_t> bottomSize_;
+    std::vector<int> topDepth_;
+    Compare comp_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the FrozenTree class.
+  -----------------------------------------------
+*/
+
+template <class Key, class Value, class Compare>
+FrozenTree<Key, Value, Compare>::FrozenTree() : height_(0), comp_()
+{
+}
+
+template <class Key, class Value, class Compare>
+template <typename InputIt>
+FrozenTree<Key, Value, Compare>::FrozenTree(InputIt first, InputIt last, const Compare &comp)
+    : height_(0), comp_(comp)
+{
+    for (; first != last; ++first)
+        items_.push_back(*first);
+    if (items_.empty())
+        return;
+
+    // @summary The smallest perfect tree with room for every item
+    while (((std::size_t)1 << height_) - 1 < items_.size())
+        height_++;
+    topSize_.assign(height_, 0);
+    bottomSize_.assign(height_, 0);
+    topDepth_.assign(height_, 0);
+    computeLevels(0, height_);
+
+    layout_.assign(((std::size_t)1 << height_) - 1, items_.back().first);
+    std::size_t pos[MAX_HEIGHT];
+    std::size_t rank = 0;
+    place(1, 0, pos, rank);
+}
+
+/**
+ * Fills the level tables for a subtree of the given height whose root is
+ * at depth. Its top tree gets the upper half of the levels (rounded down),
+ * its bottom trees the rest; every depth below the root is the root depth
+ * of bottom trees in exactly one such split.
+ */
+template <class Key, class Value, class Compare>
+void FrozenTree<Key, Value, Compare>::computeLevels(int depth, int height)
+{
+    if (height <= 1)
+        return;
+    int topHeight = height / 2;
+    int bottomHeight = height - topHeight;
+    int bottomDepth = depth + topHeight;
+    topSize_[bottomDepth] = ((std::size_t)1 << topHeight) - 1;
+    bottomSize_[bottomDepth] = ((std::size_t)1 << bottomHeight) - 1;
+    topDepth_[bottomDepth] = depth;
+    computeLevels(depth, topHeight);
+    computeLevels(bottomDepth, bottomHeight);
+}
+
+/**
+ * Returns the layout index of the node with BFS number i (the root is 1,
+ * the children of i are 2i and 2i + 1) at depth, given the layout indices
+ * pos[0 .. depth) of its ancestors. The low bits of i pick which of the
+ * bottom trees below the enclosing top tree the node roots.
+ */
+template <class Key, class Value, class Compare>
+std::size_t FrozenTree<Key, Value, Compare>::position(std::size_t i, int depth, const std::size_t *pos) const
+{
+    if (depth == 0)
+        return 0;
+    std::size_t top = topSize_[depth];
+    return pos[topDepth_[depth]] + top + (i & top) * bottomSize_[depth];
+}
+
+/**
+ * Walks the perfect tree in order from node i, writing the next keys by
+ * rank into their layout slots.
+ */
+template <class Key, class Value, class Compare>
+void FrozenTree<Key, Value, Compare>::place(std::size_t i, int depth, std::size_t *pos, std::size_t &rank)
+{
+    pos[depth] = position(i, depth, pos);
+    if (depth + 1 < height_)
+        place(2 * i, depth + 1, pos, rank);
+    if (rank < items_.size())
+        layout_[pos[depth]] = items_[rank].first;
+    rank++;
+    if (depth + 1 < height_)
+        place(2 * i + 1, depth + 1, pos, rank);
+}
+
+/**
+ * Returns the rank of the first item whose key before() rejects, or size()
+ * if there is none. before must hold for a prefix of the keys in order.
+ */
+template <class Key, class Value, class Compare>
+template <typename Before>
+std::size_t FrozenTree<Key, Value, Compare>::firstNotBefore(Before before) const
+{
+    std::size_t pos[MAX_HEIGHT];
+    std::size_t i = 1;
+    std::size_t rank = items_.size();
+    for (int d = 0; d < height_; d++)
+    {
+        pos[d] = position(i, d, pos);
+        if (before(layout_[pos[d]]))
+            i = 2 * i + 1;
+        else
+        {
+            // @summary In-order rank of the node at level offset j: (2j + 1) * 2^(levels below) - 1
+            std::size_t j = i - ((std::size_t)1 << d);
+            rank = ((2 * j + 1) << (height_ - 1 - d)) - 1;
+            i = 2 * i;
+        }
+    }
+    return rank;
+}
+
+template <class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator FrozenTree<Key, Value, Compare>::begin() const
+{
+    return items_.begin();
+}
+
+template <class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator FrozenTree<Key, Value, Compare>::end() const
+{
+    return items_.end();
+}
+
+template <class Key, class Value, class Compare>
+std::size_t FrozenTree<Key, Value, Compare>::size() const
+{
+    return items_.size();
+}
+
+template <class Key, class Value, class Compare>
+bool FrozenTree<Key, Value, Compare>::empty() const
+{
+    return items_.empty();
+}
+
+template <class Key, class Value, class Compare>
+int FrozenTree<Key, Value, Compare>::height() const
+{
+    return height_;
+}
+
+/**
+ * Returns an iterator to key, or end() if key is not in the tree
+ */
+template <class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator FrozenTree<Key, Value, Compare>::find(const Key &key) const
+{
+    iterator it = lower_bound(key);
+    if (it != end() && comp_(key, it->first))
+        return end();
+    return it;
+}
+
+/**
+ * Returns an iterator to the first item whose key is not less than key,
+ * or end() if there is none
+ */
+template <class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator FrozenTree<Key, Value, Compare>::lower_bound(const Key &key) const
+{
+    const Compare &comp = comp_;
+    return begin() + firstNotBefore([&comp, &key](const Key &k)
+                                    { return comp(k, key); });
+}
+
+/**
+ * Returns an iterator to the first item whose key is greater than key,
+ * or end() if there is none
+ */
+template <class Key, class Value, class Compare>
+typename FrozenTree<Key, Value, Compare>::iterator FrozenTree<Key, Value, Compare>::upper_bound(const Key &key) const
+{
+    const Compare &comp = comp_;
+    return begin() + firstNotBefore([&comp, &key](const Key &k)
+                                    { return !comp(key, k); });
+}
+
+/**
+ * Returns the range of items whose key is equal to key (at most one item)
+ */
+template <class Key, class Value, class Compare>
+std::pair<typename FrozenTree<Key, Value, Compare>::iterator, typename FrozenTree<Key, Value, Compare>::iterator>
+FrozenTree<Key, Value, Compare>::equal_range(const Key &key) const
+{
+    iterator lower = lower_bound(key);
+    if (lower == end() || comp_(key, lower->first))
+        return std::make_pair(lower, lower);
+    return std::make_pair(lower, lower + 1);
+}
+
+/**
+ * Returns the number of keys in [lo, hi) from two searches
+ */
+template <class Key, class Value, class Compare>
+std::size_t FrozenTree<Key, Value, Compare>::count_range(const Key &lo, const Key &hi) const
+{
+    if (!comp_(lo, hi))
+        return 0;
+    return lower_bound(hi) - lower_bound(lo);
+}
+
+#endif
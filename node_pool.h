@@ -0,0 +1,166 @@
+#ifndef NODE_POOL_H
+#define NODE_POOL_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+/**
+ * Node allocators for the search trees in bst.h and avlbst.h.
+ *
+ * A tree takes its node allocator as a template parameter. An allocator
+ * hands out uninitialized storage for one node of type T at a time and
+ * takes it back with deallocate(). Allocators with bulk_release set can
+ * also drop every node they ever handed out with a single release() call,
+ * which lets clear() skip the per-node walk when there is nothing to destroy.
+ */
+
+/**
+ * The default allocator, which sends every node to the general purpose heap.
+ */
+template <typename T>
+class HeapAllocator
+{
+public:
+    typedef T value_type;
+    static const bool bulk_release = false;
+
+    void *allocate();
+    void deallocate(void *p);
+    void release();
+};
+
+/**
+ * A slab allocator that carves nodes out of contiguous blocks of
+ * NodesPerBlock slots. Removed nodes go onto a free list and are handed
+ * out again before any new slot is used. Memory only goes back to the
+ * heap when the pool is released or destroyed, in O(blocks).
+ */
+template <typename T, std::size_t NodesPerBlock = 256>
+class NodePool
+{
+public:
+    typedef T value_type;
+    static const bool bulk_release = true;
+
+    NodePool();
+    ~NodePool();
+
+    void *allocate();
+    void deallocate(void *p);
+    void release();
+
+private:
+    // A pool owns its blocks, so it cannot be copied
+    NodePool(const NodePool &);
+    NodePool &operator=(const NodePool &);
+
+    union Slot
+    {
+        Slot *next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    struct Block
+    {
+        Block *next;
+        Slot slots[NodesPerBlock];
+    };
+
+    Block *blocks_;    // most recently allocated block first
+    Slot *freeList_;   // slots returned by deallocate()
+    std::size_t used_; // slots handed out from the head block
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the HeapAllocator class.
+  -------------------------------------------------
+*/
+
+template <typename T>
+void *HeapAllocator<T>::allocate()
+{
+    return ::operator new(sizeof(T));
+}
+
+template <typename T>
+void HeapAllocator<T>::deallocate(void *p)
+{
+    ::operator delete(p);
+}
+
+/**
+ * Nothing to do, since every node was already handed back individually.
+ */
+template <typename T>
+void HeapAllocator<T>::release()
+{
+}
+
+/*
+  ---------------------------------------------
+  Begin implementations for the NodePool class.
+  ---------------------------------------------
+*/
+
+template <typename T, std::size_t NodesPerBlock>
+NodePool<T, NodesPerBlock>::NodePool() : blocks_(NULL), freeList_(NULL), used_(NodesPerBlock)
+{
+}
+
+template <typename T, std::size_t NodesPerBlock>
+NodePool<T, NodesPerBlock>::~NodePool()
+{
+    release();
+}
+
+/**
+ * Reuses a freed slot if there is one, otherwise takes the next unused
+ * slot of the head block, starting a new block when it is full.
+ */
+template <typename T, std::size_t NodesPerBlock>
+void *NodePool<T, NodesPerBlock>::allocate()
+{
+    if (freeList_ != NULL)
+    {
+        Slot *s = freeList_;
+        freeList_ = s->next;
+        return &s->storage;
+    }
+    if (used_ == NodesPerBlock)
+    {
+        Block *b = static_cast<Block *>(::operator new(sizeof(Block)));
+        b->next = blocks_;
+        blocks_ = b;
+        used_ = 0;
+    }
+    return &blocks_->slots[used_++].storage;
+}
+
+template <typename T, std::size_t NodesPerBlock>
+void NodePool<T, NodesPerBlock>::deallocate(void *p)
+{
+    Slot *s = static_cast<Slot *>(p);
+    s->next = freeList_;
+    freeList_ = s;
+}
+
+/**
+ * Frees every block at once. Any node still living in the pool must
+ * already have been destroyed (or be trivially destructible).
+ */
+template <typename T, std::size_t NodesPerBlock>
+void NodePool<T, NodesPerBlock>::release()
+{
+    while (blocks_ != NULL)
+    {
+        Block *next = blocks_->next;
+        ::operator delete(blocks_);
+        blocks_ = next;
+    }
+    freeList_ = NULL;
+    used_ = NodesPerBlock;
+}
+
+#endif
@@ -0,0 +1,571 @@
+#ifndef PARENTLESS_AVLBST_H
+#define PARENTLESS_AVLBST_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include "avlbst.h"
+
+/**
+ * An AVL tree whose nodes have no parent pointer, for write-heavy maps
+ * where the memory and the extra stores a rotation spends on parent links
+ * matter. A node is its item, two child pointers and a balance byte.
+ *
+ * Insert and remove record the nodes on their descent path in a fixed-size
+ * array on the stack and retrace up that path instead of following parent
+ * links. Iterators likewise keep the path from the root to their node.
+ * Since an AVL tree of n < 2^64 nodes is less than MAX_HEIGHT levels deep,
+ * none of this allocates. An insert or remove may restructure any path, so
+ * it invalidates all iterators.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class ParentlessAVLTree
+{
+    struct Node;
+
+public:
+    // An AVL tree of height h has at least Fib(h + 2) - 1 nodes, which
+    // passes 2^64 at h = 92
+    static const int MAX_HEIGHT = 92;
+
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value> *pointer;
+        typedef std::pair<const Key, Value> &reference;
+
+        iterator();
+
+        std::pair<const Key, Value> &operator*() const;
+        std::pair<const Key, Value> *operator->() const;
+
+        bool operator==(const iterator &rhs) const;
+        bool operator!=(const iterator &rhs) const;
+
+        iterator &operator++();
+        iterator operator++(int);
+        iterator &operator--();
+        iterator operator--(int);
+
+    private:
+        friend class ParentlessAVLTree<Key, Value, Compare>;
+        explicit iterator(const ParentlessAVLTree<Key, Value, Compare> *tree);
+        void pushPath(Node *n, bool goLeft);
+
+        const ParentlessAVLTree<Key, Value, Compare> *tree_;
+        Node *path_[MAX_HEIGHT]; // path_[depth_ - 1] is the current node, the rest its ancestors
+        int depth_;              // 0 at end()
+    };
+
+    ParentlessAVLTree();
+    explicit ParentlessAVLTree(const Compare &comp);
+    ~ParentlessAVLTree();
+
+    void insert(const std::pair<const Key, Value> &keyValuePair);
+    void remove(const Key &key);
+    void clear();
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key &key) const;
+    Value &operator[](const Key &key);
+    Value const &operator[](const Key &key) const;
+
+    bool isBalanced() const;
+    bool empty() const;
+    std::size_t size() const;
+
+private:
+    struct Node
+    {
+        explicit Node(const std::pair<const Key, Value> &item) : item(item), left(nullptr), right(nullptr), balance(0) {}
+
+        std::pair<const Key, Value> item;
+        Node *left;
+        Node *right;
+        int8_t balance; // height(right) - height(left)
+    };
+
+    // The tree owns its nodes, so it cannot be copied
+    ParentlessAVLTree(const ParentlessAVLTree &);
+    ParentlessAVLTree &operator=(const ParentlessAVLTree &);
+
+    Node *&linkTo(Node **path, int i);
+    static Node *rotateRight(Node *n);
+    static Node *rotateLeft(Node *n);
+    static void destroy(Node *n);
+    static int checkedHeight(const Node *n, bool &balanced);
+
+    Node *root_;
+    std::size_t size_;
+    Compare comp_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the iterator class.
+  -----------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+ParentlessAVLTree<Key, Value, Compare>::iterator::iterator() : tree_(nullptr), depth_(0)
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+ParentlessAVLTree<Key, Value, Compare>::iterator::iterator(const ParentlessAVLTree<Key, Value, Compare> *tree)
+    : tree_(tree), depth_(0)
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+std::pair<const Key, Value> &ParentlessAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return path_[depth_ - 1]->item;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::pair<const Key, Value> *ParentlessAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(path_[depth_ - 1]->item);
+}
+
+template <typename Key, typename Value, typename Compare>
+bool ParentlessAVLTree<Key, Value, Compare>::iterator::operator==(const iterator &rhs) const
+{
+    if (depth_ == 0 || rhs.depth_ == 0)
+        return depth_ == rhs.depth_;
+    return path_[depth_ - 1] == rhs.path_[rhs.depth_ - 1];
+}
+
+template <typename Key, typename Value, typename Compare>
+bool ParentlessAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator &rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+ * Advances to the successor: the leftmost node of the right subtree if
+ * there is one, otherwise the nearest ancestor whose left subtree we are
+ * leaving. Popping past the root reaches end().
+ */
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator &ParentlessAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    Node *n = path_[depth_ - 1];
+    if (n->right != nullptr)
+    {
+        pushPath(n->right, true);
+        return *this;
+    }
+    depth_--;
+    while (depth_ > 0 && path_[depth_ - 1]->right == n)
+        n = path_[--depth_];
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator ParentlessAVLTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/**
+ * Steps back to the predecessor, the mirror image of operator++; --end()
+ * is the last item
+ */
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator &ParentlessAVLTree<Key, Value, Compare>::iterator::operator--()
+{
+    if (depth_ == 0)
+    {
+        pushPath(tree_->root_, false);
+        return *this;
+    }
+    Node *n = path_[depth_ - 1];
+    if (n->left != nullptr)
+    {
+        pushPath(n->left, false);
+        return *this;
+    }
+    depth_--;
+    while (depth_ > 0 && path_[depth_ - 1]->left == n)
+        n = path_[--depth_];
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator ParentlessAVLTree<Key, Value, Compare>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/**
+ * Pushes n and then its left (or right) children down to the last one
+ */
+template <typename Key, typename Value, typename Compare>
+void ParentlessAVLTree<Key, Value, Compare>::iterator::pushPath(Node *n, bool goLeft)
+{
+    for (; n != nullptr; n = goLeft ? n->left : n->right)
+        path_[depth_++] = n;
+}
+
+/*
+  -----------------------------------------------
+  Begin implementations for the ParentlessAVLTree class.
+  -----------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+ParentlessAVLTree<Key, Value, Compare>::ParentlessAVLTree() : root_(nullptr), size_(0), comp_()
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+ParentlessAVLTree<Key, Value, Compare>::ParentlessAVLTree(const Compare &comp) : root_(nullptr), size_(0), comp_(comp)
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+ParentlessAVLTree<Key, Value, Compare>::~ParentlessAVLTree()
+{
+    clear();
+}
+
+template <typename Key, typename Value, typename Compare>
+void ParentlessAVLTree<Key, Value, Compare>::clear()
+{
+    destroy(root_);
+    root_ = nullptr;
+    size_ = 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool ParentlessAVLTree<Key, Value, Compare>::empty() const
+{
+    return size_ == 0;
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t ParentlessAVLTree<Key, Value, Compare>::size() const
+{
+    return size_;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator ParentlessAVLTree<Key, Value, Compare>::begin() const
+{
+    iterator it(this);
+    it.pushPath(root_, true);
+    return it;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator ParentlessAVLTree<Key, Value, Compare>::end() const
+{
+    return iterator(this);
+}
+
+/**
+ * Returns an iterator to key, whose path is the search path itself, or
+ * end() if key is not in the tree
+ */
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::iterator ParentlessAVLTree<Key, Value, Compare>::find(const Key &key) const
+{
+    iterator it(this);
+    Node *n = root_;
+    while (n != nullptr)
+    {
+        it.path_[it.depth_++] = n;
+        if (comp_(key, n->item.first))
+            n = n->left;
+        else if (comp_(n->item.first, key))
+            n = n->right;
+        else
+            return it;
+    }
+    return end();
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template <typename Key, typename Value, typename Compare>
+Value &ParentlessAVLTree<Key, Value, Compare>::operator[](const Key &key)
+{
+    iterator it = find(key);
+    if (it == end())
+        throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+template <typename Key, typename Value, typename Compare>
+Value const &ParentlessAVLTree<Key, Value, Compare>::operator[](const Key &key) const
+{
+    iterator it = find(key);
+    if (it == end())
+        throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+/**
+ * Inserts keyValuePair, or overwrites the value if the key is already
+ * present, then retraces up the descent path recorded on the way down
+ */
+template <typename Key, typename Value, typename Compare>
+void ParentlessAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    const Key &key = keyValuePair.first;
+    Node *path[MAX_HEIGHT];
+    int depth = 0;
+    Node **link = &root_;
+    while (*link != nullptr)
+    {
+        Node *n = *link;
+        path[depth++] = n;
+        if (comp_(key, n->item.first))
+            link = &n->left;
+        else if (comp_(n->item.first, key))
+            link = &n->right;
+        else
+        {
+            // @condition If key is the same, update value
+            n->item.second = keyValuePair.second;
+            return;
+        }
+    }
+    Node *grown = new Node(keyValuePair);
+    *link = grown;
+    size_++;
+
+    // @summary Walk back up the path while the subtree below grew taller
+    for (int i = depth; i-- > 0;)
+    {
+        Node *p = path[i];
+        int8_t diff = (p->left == grown) ? -1 : 1;
+        p->balance += diff;
+        if (p->balance == 0)
+            break;
+        if (p->balance == diff)
+        {
+            grown = p;
+            continue;
+        }
+
+        Node *&pLink = linkTo(path, i);
+        if (diff < 0)
+        {
+            if (grown->balance > 0)
+                p->left = rotateLeft(grown);
+            pLink = rotateRight(p);
+        }
+        else
+        {
+            if (grown->balance < 0)
+                p->right = rotateRight(grown);
+            pLink = rotateLeft(p);
+        }
+        break;
+    }
+}
+
+/**
+ * Removes key if it is there, then retraces up the descent path recorded
+ * on the way down. A node with two children is swapped with its
+ * predecessor by relinking, so iterators' items never move between nodes.
+ */
+template <typename Key, typename Value, typename Compare>
+void ParentlessAVLTree<Key, Value, Compare>::remove(const Key &key)
+{
+    // @summary Descend to key, then on to its predecessor
+    Node *path[MAX_HEIGHT];
+    int depth = 0;
+    Node *target = nullptr;
+    int targetIndex = 0;
+    Node *n = root_;
+    while (n != nullptr)
+    {
+        path[depth++] = n;
+        if (target != nullptr)
+            n = n->right;
+        else if (comp_(key, n->item.first))
+            n = n->left;
+        else if (comp_(n->item.first, key))
+            n = n->right;
+        else
+        {
+            target = n;
+            targetIndex = depth - 1;
+            n = n->left;
+        }
+    }
+    if (target == nullptr)
+        return;
+    n = path[depth - 1];
+
+    // @condition 2 child case: the predecessor n takes target's place and links, target takes n's place on the path
+    if (n != target)
+    {
+        Node *nParent = path[depth - 2];
+        linkTo(path, targetIndex) = n;
+        if (nParent == target)
+        {
+            target->left = n->left;
+            n->left = target;
+        }
+        else
+        {
+            nParent->right = target;
+            std::swap(n->left, target->left);
+        }
+        std::swap(n->right, target->right);
+        std::swap(n->balance, target->balance);
+        path[targetIndex] = n;
+        path[depth - 1] = target;
+        n = target;
+    }
+
+    // @summary Splice n out, promoting its only child (if any)
+    Node *child = (n->left != nullptr) ? n->left : n->right;
+    int i = depth - 1;
+    bool shrankLeft = (i > 0 && path[i - 1]->left == n);
+    linkTo(path, i) = child;
+    delete n;
+    size_--;
+
+    // @summary Walk back up the path while the subtree below got shorter
+    while (i-- > 0)
+    {
+        Node *p = path[i];
+        bool pIsLeft = (i > 0 && path[i - 1]->left == p);
+        int8_t diff = shrankLeft ? 1 : -1;
+        p->balance += diff;
+
+        // @condition p was balanced, so its height did not change
+        if (p->balance == diff)
+            break;
+
+        // @condition p's taller side shrank; keep retracing
+        if (p->balance == 0)
+        {
+            shrankLeft = pIsLeft;
+            continue;
+        }
+
+        // @summary p is off by two toward its other child s
+        Node *s = (diff > 0) ? p->right : p->left;
+        int8_t sBalance = s->balance;
+        Node *&pLink = linkTo(path, i);
+        if (diff > 0)
+        {
+            if (sBalance < 0)
+                p->right = rotateRight(s);
+            pLink = rotateLeft(p);
+        }
+        else
+        {
+            if (sBalance > 0)
+                p->left = rotateLeft(s);
+            pLink = rotateRight(p);
+        }
+
+        // @condition A single rotation about a balanced child keeps the height
+        if (sBalance == 0)
+            break;
+        shrankLeft = pIsLeft;
+    }
+}
+
+/**
+ * Returns the link pointing at path[i]: a child pointer of the node before
+ * it, or the root for the first node.
+ */
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::Node *&ParentlessAVLTree<Key, Value, Compare>::linkTo(Node **path, int i)
+{
+    if (i == 0)
+        return root_;
+    Node *p = path[i - 1];
+    return (p->left == path[i]) ? p->left : p->right;
+}
+
+/**
+ * Rotates n's left child up and returns it. Only child links change, and
+ * the caller points n's old link at the result.
+ */
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::Node *ParentlessAVLTree<Key, Value, Compare>::rotateRight(Node *n)
+{
+    Node *l = n->left;
+    n->left = l->right;
+    l->right = n;
+    int nb = n->balance, lb = l->balance;
+    rightRotationBalances(nb, lb);
+    n->balance = nb;
+    l->balance = lb;
+    return l;
+}
+
+/**
+ * Rotates n's right child up and returns it
+ */
+template <typename Key, typename Value, typename Compare>
+typename ParentlessAVLTree<Key, Value, Compare>::Node *ParentlessAVLTree<Key, Value, Compare>::rotateLeft(Node *n)
+{
+    Node *r = n->right;
+    n->right = r->left;
+    r->left = n;
+    int nb = n->balance, rb = r->balance;
+    leftRotationBalances(nb, rb);
+    n->balance = nb;
+    r->balance = rb;
+    return r;
+}
+
+template <typename Key, typename Value, typename Compare>
+void ParentlessAVLTree<Key, Value, Compare>::destroy(Node *n)
+{
+    if (n == nullptr)
+        return;
+    destroy(n->left);
+    destroy(n->right);
+    delete n;
+}
+
+/**
+ * Checks every stored balance against the subtree heights
+ */
+template <typename Key, typename Value, typename Compare>
+bool ParentlessAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    bool balanced = true;
+    checkedHeight(root_, balanced);
+    return balanced;
+}
+
+template <typename Key, typename Value, typename Compare>
+int ParentlessAVLTree<Key, Value, Compare>::checkedHeight(const Node *n, bool &balanced)
+{
+    if (n == nullptr)
+        return 0;
+    int lh = checkedHeight(n->left, balanced);
+    int rh = checkedHeight(n->right, balanced);
+    if (n->balance != rh - lh || rh - lh > 1 || lh - rh > 1)
+        balanced = false;
+    return std::max(lh, rh) + 1;
+}
+
+#endif
@@ -0,0 +1,651 @@
+#ifndef PERSISTENT_AVLBST_H
+#define PERSISTENT_AVLBST_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+ * An AVL tree whose versions share structure, so that snapshot() is O(1).
+ *
+ * Nodes are reference counted. A snapshot just takes another reference to
+ * the root and from then on the nodes it can reach are never changed.
+ * Writes copy a node only if something else still references it: insert and
+ * remove copy the nodes on their root-to-leaf path (plus, for a remove, the
+ * one or two nodes a rotation pulls in) the first time they touch them
+ * after a snapshot, and modify the copies in place from then on. With no
+ * snapshot alive nothing is copied at all.
+ *
+ * A Snapshot is immutable, so any number of threads may read it, copy it
+ * and destroy it without locks while the tree keeps changing. The counts
+ * are atomic, so the last of the tree and its snapshots to let go of a
+ * node frees it, whichever thread that is on. The tree itself, including
+ * snapshot(), is meant for one writer thread at a time, like AVLTree.
+ *
+ * Iterators keep a stack of the ancestors still to visit instead of using
+ * parent links, which shared nodes cannot have. They are forward only, stay
+ * valid as long as their snapshot does, and (like the tree's own iterators
+ * after an insert or remove) must not be used once the version they were
+ * taken from is gone.
+ */
+template <typename Key, typename Value, typename Compare = std::less<Key> >
+class PersistentAVLTree
+{
+    struct Node;
+
+public:
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value> *pointer;
+        typedef const std::pair<const Key, Value> &reference;
+
+        iterator();
+
+        const std::pair<const Key, Value> &operator*() const;
+        const std::pair<const Key, Value> *operator->() const;
+
+        bool operator==(const iterator &rhs) const;
+        bool operator!=(const iterator &rhs) const;
+
+        iterator &operator++();
+        iterator operator++(int);
+
+    private:
+        friend class PersistentAVLTree<Key, Value, Compare>;
+        void pushLeftPath(const Node *n);
+        std::vector<const Node *> pending_; // back() is the current node, the rest its unvisited ancestors
+    };
+
+    /**
+     * A read-only version of the tree. Copying one is O(1).
+     */
+    class Snapshot
+    {
+    public:
+        Snapshot();
+        explicit Snapshot(const Compare &comp);
+        Snapshot(const Snapshot &other);
+        Snapshot &operator=(const Snapshot &other);
+        ~Snapshot();
+
+        iterator find(const Key &key) const;
+        iterator begin() const;
+        iterator end() const;
+        std::size_t size() const;
+        bool empty() const;
+        bool isBalanced() const;
+
+    private:
+        friend class PersistentAVLTree<Key, Value, Compare>;
+        Node *root_;
+        std::size_t size_;
+        Compare comp_;
+    };
+
+    PersistentAVLTree();
+    explicit PersistentAVLTree(const Compare &comp);
+
+    void insert(const std::pair<const Key, Value> &keyValuePair);
+    bool remove(const Key &key);
+    void clear();
+    Snapshot snapshot() const;
+
+    iterator find(const Key &key) const;
+    iterator begin() const;
+    iterator end() const;
+    std::size_t size() const;
+    bool empty() const;
+    bool isBalanced() const;
+
+private:
+    struct Node
+    {
+        Node(const std::pair<const Key, Value> &item, Node *left, Node *right, int8_t balance)
+            : item(item), left(left), right(right), balance(balance), refs(1) {}
+
+        std::pair<const Key, Value> item;
+        Node *left;
+        Node *right;
+        int8_t balance; // height(right) - height(left)
+        std::atomic<uint32_t> refs;
+    };
+
+    Node *own(Node *&link);
+    Node *&linkTo(std::vector<Node *> &path, std::size_t i);
+    static void retain(Node *n);
+    static void release(Node *n);
+    static Node *rotateRight(Node *n);
+    static Node *rotateLeft(Node *n);
+    static int checkedHeight(const Node *n, bool &balanced);
+
+    Snapshot current_; // the latest version, which only this tree may change
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the iterator class.
+  -----------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::iterator::iterator()
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value> &PersistentAVLTree<Key, Value, Compare>::iterator::operator*() const
+{
+    return pending_.back()->item;
+}
+
+template <typename Key, typename Value, typename Compare>
+const std::pair<const Key, Value> *PersistentAVLTree<Key, Value, Compare>::iterator::operator->() const
+{
+    return &(pending_.back()->item);
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator==(const iterator &rhs) const
+{
+    if (pending_.empty() || rhs.pending_.empty())
+        return pending_.empty() == rhs.pending_.empty();
+    return pending_.back() == rhs.pending_.back();
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::iterator::operator!=(const iterator &rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+ * Advances to the successor: the leftmost node of the right subtree if
+ * there is one, otherwise the nearest ancestor still pending.
+ */
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator &PersistentAVLTree<Key, Value, Compare>::iterator::operator++()
+{
+    const Node *n = pending_.back();
+    pending_.pop_back();
+    pushLeftPath(n->right);
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::iterator::operator++(int)
+{
+    iterator old = *this;
+    ++(*this);
+    return old;
+}
+
+template <typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::iterator::pushLeftPath(const Node *n)
+{
+    for (; n != nullptr; n = n->left)
+        pending_.push_back(n);
+}
+
+/*
+  -----------------------------------------------
+  Begin implementations for the Snapshot class.
+  -----------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::Snapshot::Snapshot() : root_(nullptr), size_(0), comp_()
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::Snapshot::Snapshot(const Compare &comp) : root_(nullptr), size_(0), comp_(comp)
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::Snapshot::Snapshot(const Snapshot &other)
+    : root_(other.root_), size_(other.size_), comp_(other.comp_)
+{
+    retain(root_);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Snapshot &
+PersistentAVLTree<Key, Value, Compare>::Snapshot::operator=(const Snapshot &other)
+{
+    // @summary Retain before releasing, so self-assignment is harmless
+    retain(other.root_);
+    release(root_);
+    root_ = other.root_;
+    size_ = other.size_;
+    comp_ = other.comp_;
+    return *this;
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::Snapshot::~Snapshot()
+{
+    release(root_);
+}
+
+/**
+ * Returns an iterator to key, or end() if key is not in this version.
+ */
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::Snapshot::find(const Key &key) const
+{
+    // @summary Record the nodes we go left at: they come after key in order
+    iterator it;
+    const Node *n = root_;
+    while (n != nullptr)
+    {
+        if (comp_(key, n->item.first))
+        {
+            it.pending_.push_back(n);
+            n = n->left;
+        }
+        else if (comp_(n->item.first, key))
+            n = n->right;
+        else
+        {
+            it.pending_.push_back(n);
+            return it;
+        }
+    }
+    return end();
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::Snapshot::begin() const
+{
+    iterator it;
+    it.pushLeftPath(root_);
+    return it;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::Snapshot::end() const
+{
+    return iterator();
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::Snapshot::size() const
+{
+    return size_;
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::Snapshot::empty() const
+{
+    return size_ == 0;
+}
+
+/**
+ * Checks that every stored balance matches the subtree heights and is
+ * within [-1, 1].
+ */
+template <typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::Snapshot::isBalanced() const
+{
+    bool balanced = true;
+    checkedHeight(root_, balanced);
+    return balanced;
+}
+
+/*
+  ---------------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ---------------------------------------------------------
+*/
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree() : current_()
+{
+}
+
+template <typename Key, typename Value, typename Compare>
+PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare &comp) : current_(comp)
+{
+}
+
+/**
+ * Returns the current version, which later writes to this tree leave
+ * untouched. O(1).
+ */
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Snapshot PersistentAVLTree<Key, Value, Compare>::snapshot() const
+{
+    return current_;
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::find(const Key &key) const
+{
+    return current_.find(key);
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::begin() const
+{
+    return current_.begin();
+}
+
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::iterator PersistentAVLTree<Key, Value, Compare>::end() const
+{
+    return current_.end();
+}
+
+template <typename Key, typename Value, typename Compare>
+std::size_t PersistentAVLTree<Key, Value, Compare>::size() const
+{
+    return current_.size();
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::empty() const
+{
+    return current_.empty();
+}
+
+template <typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::isBalanced() const
+{
+    return current_.isBalanced();
+}
+
+/**
+ * Inserts keyValuePair, or overwrites the value if the key is already
+ * present. Snapshots taken before keep seeing the old contents.
+ */
+template <typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::insert(const std::pair<const Key, Value> &keyValuePair)
+{
+    const Key &key = keyValuePair.first;
+    const Compare &comp = current_.comp_;
+
+    // @summary Descend, making every node on the path our own so it can be changed in place
+    std::vector<Node *> path;
+    Node **link = &current_.root_;
+    bool goLeft = false;
+    while (*link != nullptr)
+    {
+        Node *n = own(*link);
+        path.push_back(n);
+        if (comp(key, n->item.first))
+            goLeft = true;
+        else if (comp(n->item.first, key))
+            goLeft = false;
+        else
+        {
+            // @condition If key is the same, update value
+            n->item.second = keyValuePair.second;
+            return;
+        }
+        link = goLeft ? &n->left : &n->right;
+    }
+    Node *grown = new Node(keyValuePair, nullptr, nullptr, 0);
+    *link = grown;
+    current_.size_++;
+
+    // @summary Retrace up the owned path; rotations only touch path nodes, so nothing more is copied
+    for (std::size_t i = path.size(); i-- > 0;)
+    {
+        Node *p = path[i];
+        int8_t diff = (p->left == grown) ? -1 : 1;
+        p->balance += diff;
+        if (p->balance == 0)
+            break;
+        if (p->balance == diff)
+        {
+            grown = p;
+            continue;
+        }
+
+        Node *&pLink = linkTo(path, i);
+        if (diff < 0)
+        {
+            if (grown->balance > 0)
+                p->left = rotateLeft(grown);
+            pLink = rotateRight(p);
+        }
+        else
+        {
+            if (grown->balance < 0)
+                p->right = rotateRight(grown);
+            pLink = rotateLeft(p);
+        }
+        break;
+    }
+}
+
+/**
+ * Removes key and returns true, or returns false if it is not in the tree.
+ * A node with two children is replaced by a copy of its predecessor's item,
+ * since the key in a shared node cannot be overwritten.
+ */
+template <typename Key, typename Value, typename Compare>
+bool PersistentAVLTree<Key, Value, Compare>::remove(const Key &key)
+{
+    // @condition Nothing to remove: don't copy a path for it
+    if (current_.find(key) == current_.end())
+        return false;
+    const Compare &comp = current_.comp_;
+
+    // @summary Descend to key, then on to its predecessor, owning every node on the way
+    std::vector<Node *> path;
+    Node **link = &current_.root_;
+    Node *target = nullptr;
+    std::size_t targetIndex = 0;
+    while (*link != nullptr)
+    {
+        Node *n = own(*link);
+        path.push_back(n);
+        bool goLeft;
+        if (target != nullptr)
+            goLeft = false;
+        else if (comp(key, n->item.first))
+            goLeft = true;
+        else if (comp(n->item.first, key))
+            goLeft = false;
+        else
+        {
+            target = n;
+            targetIndex = path.size() - 1;
+            goLeft = true;
+        }
+        link = goLeft ? &n->left : &n->right;
+    }
+    Node *n = path.back();
+
+    // @condition 2 child case: a fresh node with n's item takes target's place and links
+    if (n != target)
+    {
+        Node *moved = new Node(n->item, target->left, target->right, target->balance);
+        linkTo(path, targetIndex) = moved;
+        path[targetIndex] = moved;
+        delete target;
+    }
+
+    // @summary Splice n out, promoting its only child (if any)
+    Node *child = (n->left != nullptr) ? n->left : n->right;
+    std::size_t i = path.size() - 1;
+    bool shrankLeft = (i > 0 && path[i - 1]->left == n);
+    linkTo(path, i) = child;
+    path.pop_back();
+    delete n;
+    current_.size_--;
+
+    // @summary Retrace up the owned path, copying any shared sibling a rotation pulls in
+    while (i-- > 0)
+    {
+        Node *p = path[i];
+        bool pIsLeft = (i > 0 && path[i - 1]->left == p);
+        int8_t diff = shrankLeft ? 1 : -1;
+        p->balance += diff;
+
+        // @condition p was balanced, so its height did not change
+        if (p->balance == diff)
+            break;
+
+        // @condition p's taller side shrank; keep retracing
+        if (p->balance == 0)
+        {
+            shrankLeft = pIsLeft;
+            continue;
+        }
+
+        // @summary p is off by two toward its other child s, which is off the path and may be shared
+        Node *s = own((diff > 0) ? p->right : p->left);
+        int8_t sBalance = s->balance;
+        bool zigZag = (diff > 0) ? (sBalance < 0) : (sBalance > 0);
+        Node *&pLink = linkTo(path, i);
+        if (diff > 0)
+        {
+            if (zigZag)
+            {
+                own(s->left);
+                p->right = rotateRight(s);
+            }
+            pLink = rotateLeft(p);
+        }
+        else
+        {
+            if (zigZag)
+            {
+                own(s->right);
+                p->left = rotateLeft(s);
+            }
+            pLink = rotateRight(p);
+        }
+
+        // @condition A single rotation about a balanced child keeps the height
+        if (sBalance == 0)
+            break;
+        shrankLeft = pIsLeft;
+    }
+    return true;
+}
+
+/**
+ * Empties the tree. Nodes still reachable from a snapshot stay alive.
+ */
+template <typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::clear()
+{
+    release(current_.root_);
+    current_.root_ = nullptr;
+    current_.size_ = 0;
+}
+
+/**
+ * Returns the node link points at, first replacing it with a private copy
+ * if anything besides link references it. The copy takes over the
+ * original's children, which gain a reference.
+ */
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node *PersistentAVLTree<Key, Value, Compare>::own(Node *&link)
+{
+    Node *n = link;
+    if (n->refs.load(std::memory_order_acquire) == 1)
+        return n;
+    Node *copy = new Node(n->item, n->left, n->right, n->balance);
+    retain(copy->left);
+    retain(copy->right);
+    release(n);
+    link = copy;
+    return copy;
+}
+
+/**
+ * Returns the link pointing at path[i]: a child pointer of the node before
+ * it, or the root for the first node.
+ */
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node *&
+PersistentAVLTree<Key, Value, Compare>::linkTo(std::vector<Node *> &path, std::size_t i)
+{
+    if (i == 0)
+        return current_.root_;
+    Node *p = path[i - 1];
+    return (p->left == path[i]) ? p->left : p->right;
+}
+
+template <typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::retain(Node *n)
+{
+    if (n != nullptr)
+        n->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * Drops one reference to n, freeing n (and dropping its references to its
+ * children) if it was the last.
+ */
+template <typename Key, typename Value, typename Compare>
+void PersistentAVLTree<Key, Value, Compare>::release(Node *n)
+{
+    if (n != nullptr && n->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        release(n->left);
+        release(n->right);
+        delete n;
+    }
+}
+
+/**
+ * Rotates n's left child up and returns it. Both must be owned.
+ */
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node *PersistentAVLTree<Key, Value, Compare>::rotateRight(Node *n)
+{
+    Node *l = n->left;
+    n->left = l->right;
+    l->right = n;
+    int nb = n->balance, lb = l->balance;
+    rightRotationBalances(nb, lb);
+    n->balance = nb;
+    l->balance = lb;
+    return l;
+}
+
+/**
+ * Rotates n's right child up and returns it. Both must be owned.
+ */
+template <typename Key, typename Value, typename Compare>
+typename PersistentAVLTree<Key, Value, Compare>::Node *PersistentAVLTree<Key, Value, Compare>::rotateLeft(Node *n)
+{
+    Node *r = n->right;
+    n->right = r->left;
+    r->left = n;
+    int nb = n->balance, rb = r->balance;
+    leftRotationBalances(nb, rb);
+    n->balance = nb;
+    r->balance = rb;
+    return r;
+}
+
+template <typename Key, typename Value, typename Compare>
+int PersistentAVLTree<Key, Value, Compare>::checkedHeight(const Node *n, bool &balanced)
+{
+    if (n == nullptr)
+        return 0;
+    int lh = checkedHeight(n->left, balanced);
+    int rh = checkedHeight(n->right, balanced);
+    if (n->balance != rh - lh || rh - lh > 1 || lh - rh > 1)
+        balanced = false;
+    return std::max(lh, rh) + 1;
+}
+
+#endif
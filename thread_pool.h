@@ -0,0 +1,190 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * A small fork-join thread pool for the divide-and-conquer tree algorithms
+ * in avlbst.h. fork_join(f, g) offers g to the pool's workers, runs f on the
+ * calling thread and returns once both are done. A thread waiting for its g
+ * runs other queued tasks in the meantime, newest first (usually the g it
+ * just forked), so nested fork_join calls never deadlock and no thread sits
+ * idle while there is work queued.
+ */
+class ThreadPool
+{
+public:
+    // threads counts the calling thread, so ThreadPool(1) runs everything inline
+    explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    template <typename F, typename G>
+    void fork_join(F &&f, G &&g);
+    unsigned size() const;
+
+    // A process-wide pool with one thread per hardware thread
+    static ThreadPool &shared();
+
+private:
+    // A pool owns its threads, so it cannot be copied
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    struct Task
+    {
+        std::function<void()> run;
+        std::exception_ptr error;
+        std::atomic<bool> done;
+    };
+
+    bool runQueued(bool newest);
+    void work();
+
+    std::vector<std::thread> workers_;
+    std::deque<Task *> queue_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool stopping_;
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the ThreadPool class.
+  -----------------------------------------------
+*/
+
+inline ThreadPool::ThreadPool(unsigned threads) : stopping_(false)
+{
+    for (unsigned i = 1; i < threads; i++)
+        workers_.push_back(std::thread(&ThreadPool::work, this));
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    for (std::size_t i = 0; i < workers_.size(); i++)
+        workers_[i].join();
+}
+
+inline unsigned ThreadPool::size() const
+{
+    return workers_.size() + 1;
+}
+
+inline ThreadPool &ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+/**
+ * Runs f and g, possibly in parallel, and rethrows the first exception
+ * either of them threw once both have finished.
+ */
+template <typename F, typename G>
+void ThreadPool::fork_join(F &&f, G &&g)
+{
+    if (workers_.empty())
+    {
+        f();
+        g();
+        return;
+    }
+
+    Task task;
+    task.run = [&g]()
+    { g(); };
+    task.done.store(false, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(&task);
+    }
+    ready_.notify_one();
+
+    std::exception_ptr error;
+    try
+    {
+        f();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    // @summary g lives on our stack, so wait for it even if f threw, helping out meanwhile
+    while (!task.done.load(std::memory_order_acquire))
+    {
+        if (!runQueued(true))
+            std::this_thread::yield();
+    }
+    if (error)
+        std::rethrow_exception(error);
+    if (task.error)
+        std::rethrow_exception(task.error);
+}
+
+/**
+ * Runs one queued task, the newest or the oldest one, if there is any.
+ * Returns whether a task was run.
+ */
+inline bool ThreadPool::runQueued(bool newest)
+{
+    Task *task;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.empty())
+            return false;
+        if (newest)
+        {
+            task = queue_.back();
+            queue_.pop_back();
+        }
+        else
+        {
+            task = queue_.front();
+            queue_.pop_front();
+        }
+    }
+    try
+    {
+        task->run();
+    }
+    catch (...)
+    {
+        task->error = std::current_exception();
+    }
+    task->done.store(true, std::memory_order_release);
+    return true;
+}
+
+/**
+ * The worker threads' loop. Workers take the oldest task, which in a
+ * divide-and-conquer algorithm is the largest piece of work available.
+ */
+inline void ThreadPool::work()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_.wait(lock, [this]()
+                        { return stopping_ || !queue_.empty(); });
+            if (queue_.empty())
+                return;
+        }
+        runQueued(false);
+    }
+}
+
+#endif